@@ -365,10 +365,6 @@ static int fw_decompress_xz_single(struct device *dev, struct fw_priv *fw_priv,
 	struct xz_buf xz_buf;
 	enum xz_ret xz_ret;
 
-	xz_dec = xz_dec_init(XZ_SINGLE, (u32)-1);
-	if (!xz_dec)
-		return -ENOMEM;
-
 	xz_buf.in_size = in_size;
 	xz_buf.in = in_buffer;
 	xz_buf.in_pos = 0;
@@ -376,8 +372,17 @@ static int fw_decompress_xz_single(struct device *dev, struct fw_priv *fw_priv,
 	xz_buf.out = fw_priv->data;
 	xz_buf.out_pos = 0;
 
-	xz_ret = xz_dec_run(xz_dec, &xz_buf);
-	xz_dec_end(xz_dec);
+	/* images packed with "xz -T" or "--block-size" decode in parallel */
+	if (IS_ENABLED(CONFIG_XZ_DEC_MT)) {
+		xz_ret = xz_dec_mt_run(&xz_buf, 0);
+	} else {
+		xz_dec = xz_dec_init(XZ_SINGLE, (u32)-1);
+		if (!xz_dec)
+			return -ENOMEM;
+
+		xz_ret = xz_dec_run(xz_dec, &xz_buf);
+		xz_dec_end(xz_dec);
+	}
 
 	fw_priv->size = xz_buf.out_pos;
 	return fw_decompress_xz_error(dev, xz_ret);
@@ -925,8 +925,18 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	unsigned int i;
+
+	for (i = 0; i < lo->tag_set.nr_hw_queues; i++) {
+		struct loop_worker *lw = &lo->workers[i];
+
+		if (IS_ERR_OR_NULL(lw->task))
+			continue;
+		kthread_flush_worker(&lw->worker);
+		kthread_stop(lw->task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
 }
 
 static int loop_kthread_worker_fn(void *worker_ptr)
@@ -935,14 +945,36 @@ static int loop_kthread_worker_fn(void *worker_ptr)
 	return kthread_worker_fn(worker_ptr);
 }
 
+static void loop_queue_work(struct kthread_work *work);
+
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int i, nr = lo->tag_set.nr_hw_queues;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	for (i = 0; i < nr; i++) {
+		struct loop_worker *lw = &lo->workers[i];
+
+		spin_lock_init(&lw->lock);
+		INIT_LIST_HEAD(&lw->cmd_list);
+		kthread_init_work(&lw->work, loop_queue_work);
+		kthread_init_worker(&lw->worker);
+		if (nr == 1)
+			lw->task = kthread_run(loop_kthread_worker_fn,
+					&lw->worker, "loop%d", lo->lo_number);
+		else
+			lw->task = kthread_run(loop_kthread_worker_fn,
+					&lw->worker, "loop%d.%u",
+					lo->lo_number, i);
+		if (IS_ERR(lw->task)) {
+			loop_unprepare_queue(lo);
+			return -ENOMEM;
+		}
+		set_user_nice(lw->task, MIN_NICE);
+	}
 	return 0;
 }
 
@@ -1962,6 +1994,9 @@ module_param(max_loop, int, 0444);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, 0444);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+static unsigned int hw_queues = 1;
+module_param(hw_queues, uint, 0444);
+MODULE_PARM_DESC(hw_queues, "Number of hardware queues and worker threads per loop device (default: 1)");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -2009,6 +2044,7 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	struct request *rq = bd->rq;
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	struct loop_device *lo = rq->q->queuedata;
+	struct loop_worker *lw;
 
 	blk_mq_start_request(rq);
 
@@ -2034,11 +2070,27 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	} else
 #endif
 		cmd->css = NULL;
-	kthread_queue_work(&lo->worker, &cmd->work);
+
+	lw = &lo->workers[hctx->queue_num];
+	spin_lock(&lw->lock);
+	list_add_tail(&cmd->list, &lw->cmd_list);
+	spin_unlock(&lw->lock);
+
+	/* Wake the worker once per dispatch batch, not once per request */
+	if (bd->last)
+		kthread_queue_work(&lw->worker, &lw->work);
 
 	return BLK_STS_OK;
 }
 
+static void loop_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	struct loop_device *lo = hctx->queue->queuedata;
+
+	kthread_queue_work(&lo->workers[hctx->queue_num].worker,
+			   &lo->workers[hctx->queue_num].work);
+}
+
 static void loop_handle_cmd(struct loop_cmd *cmd)
 {
 	struct request *rq = blk_mq_rq_from_pdu(cmd);
@@ -2062,24 +2114,28 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 
 static void loop_queue_work(struct kthread_work *work)
 {
-	struct loop_cmd *cmd =
-		container_of(work, struct loop_cmd, work);
-
-	loop_handle_cmd(cmd);
-}
-
-static int loop_init_request(struct blk_mq_tag_set *set, struct request *rq,
-		unsigned int hctx_idx, unsigned int numa_node)
-{
-	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
-
-	kthread_init_work(&cmd->work, loop_queue_work);
-	return 0;
+	struct loop_worker *lw =
+		container_of(work, struct loop_worker, work);
+	struct loop_cmd *cmd, *next;
+	struct blk_plug plug;
+	LIST_HEAD(cmd_list);
+
+	spin_lock(&lw->lock);
+	list_splice_init(&lw->cmd_list, &cmd_list);
+	spin_unlock(&lw->lock);
+
+	/* Let the backing device see the whole batch of AIO at once */
+	blk_start_plug(&plug);
+	list_for_each_entry_safe(cmd, next, &cmd_list, list) {
+		list_del_init(&cmd->list);
+		loop_handle_cmd(cmd);
+	}
+	blk_finish_plug(&plug);
 }
 
 static const struct blk_mq_ops loop_mq_ops = {
 	.queue_rq       = loop_queue_rq,
-	.init_request	= loop_init_request,
+	.commit_rqs	= loop_commit_rqs,
 	.complete	= lo_complete_rq,
 };
 
@@ -2110,7 +2166,7 @@ static int loop_add(struct loop_device **l, int i)
 
 	err = -ENOMEM;
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = hw_queues;
 	lo->tag_set.queue_depth = 128;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
@@ -2352,6 +2408,8 @@ static int __init loop_init(void)
 		goto err_out;
 	}
 
+	hw_queues = clamp_t(unsigned int, hw_queues, 1, nr_cpu_ids);
+
 	/*
 	 * If max_loop is specified, create that many devices upfront.
 	 * This also becomes a hard limit. If max_loop is not specified,
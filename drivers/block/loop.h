@@ -25,6 +25,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_worker;
 
 struct loop_device {
 	int		lo_number;
@@ -54,8 +55,7 @@ struct loop_device {
 
 	spinlock_t		lo_lock;
 	int			lo_state;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct loop_worker	*workers;	/* one per hw queue */
 	bool			use_dio;
 	bool			sysfs_inited;
 
@@ -64,8 +64,21 @@ struct loop_device {
 	struct gendisk		*lo_disk;
 };
 
+/*
+ * Commands are collected on cmd_list by ->queue_rq and handed to the
+ * kthread in batches, so that the AIO submissions of a batch can be
+ * plugged together.
+ */
+struct loop_worker {
+	struct kthread_worker	worker;
+	struct task_struct	*task;
+	struct kthread_work	work;
+	spinlock_t		lock;
+	struct list_head	cmd_list;
+};
+
 struct loop_cmd {
-	struct kthread_work work;
+	struct list_head list;
 	bool use_aio; /* use AIO interface to handle I/O */
 	atomic_t ref; /* only for aio */
 	long ret;
@@ -57,8 +57,19 @@ struct nbd_sock {
 	struct request *pending;
 	int sent;
 	bool dead;
+	bool corked;	/* last send had MSG_MORE, the next one pushes it */
 	int fallback_index;
 	int cookie;
+
+	/* Load seen by request steering, see nbd_pick_sock() */
+	atomic_t inflight;
+	atomic_t inflight_bytes;
+	u64 lat_ewma_ns;
+
+	atomic64_t nr_sent;
+	atomic64_t bytes_sent;
+	atomic64_t nr_completed;
+	atomic64_t nr_steered;
 };
 
 struct recv_thread_args {
@@ -123,6 +134,11 @@ struct nbd_device {
 
 #define NBD_CMD_REQUEUED	1
 
+/* Smallest in-flight charge of a request, so flushes and tiny I/O count */
+#define NBD_MIN_CHARGE		4096
+/* Weight of a new sample in the per-socket latency average: 1/8 */
+#define NBD_LAT_EWMA_SHIFT	3
+
 struct nbd_cmd {
 	struct nbd_device *nbd;
 	struct mutex lock;
@@ -132,6 +148,8 @@ struct nbd_cmd {
 	blk_status_t status;
 	unsigned long flags;
 	u32 cmd_cookie;
+	unsigned int charge;	/* bytes accounted to socks[index] */
+	u64 send_ns;
 };
 
 #if IS_ENABLED(CONFIG_DEBUG_FS)
@@ -169,6 +187,37 @@ static void nbd_requeue_cmd(struct nbd_cmd *cmd)
 		blk_mq_requeue_request(req, true);
 }
 
+/*
+ * Drop the in-flight charge of a request from the connection it was sent on.
+ * Call with cmd->lock held; @completed feeds the latency average.
+ */
+static void nbd_cmd_uncharge(struct nbd_device *nbd, struct nbd_cmd *cmd,
+			     bool completed)
+{
+	struct nbd_sock *nsock;
+
+	if (!cmd->charge)
+		return;
+
+	nsock = nbd->config->socks[cmd->index];
+	atomic_sub(cmd->charge, &nsock->inflight_bytes);
+	atomic_dec(&nsock->inflight);
+	cmd->charge = 0;
+
+	if (completed) {
+		u64 lat = ktime_get_ns() - cmd->send_ns;
+		u64 avg = READ_ONCE(nsock->lat_ewma_ns);
+
+		if (avg)
+			avg += (lat >> NBD_LAT_EWMA_SHIFT) -
+			       (avg >> NBD_LAT_EWMA_SHIFT);
+		else
+			avg = lat;
+		WRITE_ONCE(nsock->lat_ewma_ns, avg);
+		atomic64_inc(&nsock->nr_completed);
+	}
+}
+
 #define NBD_COOKIE_BITS 32
 
 static u64 nbd_cmd_handle(struct nbd_cmd *cmd)
@@ -390,6 +439,8 @@ static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
 
 	if (!refcount_inc_not_zero(&nbd->config_refs)) {
 		cmd->status = BLK_STS_TIMEOUT;
+		/* The connections are gone along with the config */
+		cmd->charge = 0;
 		mutex_unlock(&cmd->lock);
 		goto done;
 	}
@@ -419,6 +470,7 @@ static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
 					nbd_mark_nsock_dead(nbd, nsock, 1);
 				mutex_unlock(&nsock->tx_lock);
 			}
+			nbd_cmd_uncharge(nbd, cmd, false);
 			mutex_unlock(&cmd->lock);
 			nbd_requeue_cmd(cmd);
 			nbd_config_put(nbd);
@@ -445,6 +497,7 @@ static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
 	dev_err_ratelimited(nbd_to_dev(nbd), "Connection timed out\n");
 	set_bit(NBD_RT_TIMEDOUT, &config->runtime_flags);
 	cmd->status = BLK_STS_IOERR;
+	nbd_cmd_uncharge(nbd, cmd, false);
 	mutex_unlock(&cmd->lock);
 	sock_shutdown(nbd);
 	nbd_config_put(nbd);
@@ -511,8 +564,12 @@ static inline int was_interrupted(int result)
 	return result == -ERESTARTSYS || result == -EINTR;
 }
 
-/* always call with the tx_lock held */
-static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
+/*
+ * always call with the tx_lock held. With @more set the request is sent with
+ * MSG_MORE all the way, as the next one of the dispatch batch will follow.
+ */
+static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index,
+			bool more)
 {
 	struct request *req = blk_mq_rq_from_pdu(cmd);
 	struct nbd_config *config = nbd->config;
@@ -578,7 +635,7 @@ static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
 		req, nbdcmd_to_ascii(type),
 		(unsigned long long)blk_rq_pos(req) << 9, blk_rq_bytes(req));
 	result = sock_xmit(nbd, index, 1, &from,
-			(type == NBD_CMD_WRITE) ? MSG_MORE : 0, &sent);
+			(type == NBD_CMD_WRITE || more) ? MSG_MORE : 0, &sent);
 	trace_nbd_header_sent(req, handle);
 	if (result <= 0) {
 		if (was_interrupted(result)) {
@@ -610,7 +667,7 @@ static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
 
 		bio_for_each_segment(bvec, bio, iter) {
 			bool is_last = !next && bio_iter_last(bvec, iter);
-			int flags = is_last ? 0 : MSG_MORE;
+			int flags = is_last && !more ? 0 : MSG_MORE;
 
 			dev_dbg(nbd_to_dev(nbd), "request %p: sending %d bytes data\n",
 				req, bvec.bv_len);
@@ -655,6 +712,9 @@ static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
 	trace_nbd_payload_sent(req, handle);
 	nsock->pending = NULL;
 	nsock->sent = 0;
+	nsock->corked = more;
+	atomic64_inc(&nsock->nr_sent);
+	atomic64_add(size, &nsock->bytes_sent);
 	return 0;
 }
 
@@ -722,6 +782,7 @@ static struct nbd_cmd *nbd_read_stat(struct nbd_device *nbd, int index)
 		ret = -ENOENT;
 		goto out;
 	}
+	nbd_cmd_uncharge(nbd, cmd, true);
 	if (ntohl(reply.error)) {
 		dev_err(disk_to_dev(nbd->disk), "Other side returned error (%d)\n",
 			ntohl(reply.error));
@@ -803,6 +864,7 @@ static bool nbd_clear_req(struct request *req, void *data, bool reserved)
 
 	mutex_lock(&cmd->lock);
 	cmd->status = BLK_STS_IOERR;
+	nbd_cmd_uncharge(cmd->nbd, cmd, false);
 	mutex_unlock(&cmd->lock);
 
 	blk_mq_complete_request(req);
@@ -876,12 +938,68 @@ static int wait_for_reconnect(struct nbd_device *nbd)
 	return !test_bit(NBD_RT_DISCONNECTED, &config->runtime_flags);
 }
 
-static int nbd_handle_cmd(struct nbd_cmd *cmd, int index)
+static u64 nbd_sock_cost(struct nbd_sock *nsock, unsigned int charge)
+{
+	u64 lat_us = READ_ONCE(nsock->lat_ewma_ns) >> 10;
+
+	if (READ_ONCE(nsock->dead))
+		return U64_MAX;
+	return ((u64)atomic_read(&nsock->inflight_bytes) + charge) *
+	       (lat_us + 1);
+}
+
+/*
+ * Pick the connection for a request: the one of its hardware queue, unless
+ * another connection would get it through at least twice as fast, judged by
+ * the bytes in flight and the recent reply latency. A request which was
+ * partially sent has to go back to the connection it started on.
+ *
+ * A dispatch batch stays on its own connection: requests sent with MSG_MORE
+ * (@more) are not moved, and neither is the one following them, which has to
+ * push out what they left queued.
+ */
+static int nbd_pick_sock(struct nbd_device *nbd, struct nbd_cmd *cmd,
+			 int index, unsigned int charge, bool more)
+{
+	struct request *req = blk_mq_rq_from_pdu(cmd);
+	struct nbd_config *config = nbd->config;
+	u64 cost, best_cost;
+	int i, best = -1;
+
+	if (more || config->num_connections <= 1 ||
+	    index >= config->num_connections ||
+	    READ_ONCE(config->socks[index]->corked))
+		return index;
+	if (cmd->index < config->num_connections &&
+	    READ_ONCE(config->socks[cmd->index]->pending) == req)
+		return cmd->index;
+
+	best_cost = nbd_sock_cost(config->socks[index], charge);
+	if (best_cost != U64_MAX)
+		best_cost /= 2;
+
+	for (i = 0; i < config->num_connections; i++) {
+		struct nbd_sock *nsock = config->socks[i];
+
+		if (i == index || READ_ONCE(nsock->pending))
+			continue;
+		cost = nbd_sock_cost(nsock, charge);
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = i;
+		}
+	}
+	return best < 0 ? index : best;
+}
+
+static int nbd_handle_cmd(struct nbd_cmd *cmd, int index, bool more)
 {
 	struct request *req = blk_mq_rq_from_pdu(cmd);
 	struct nbd_device *nbd = cmd->nbd;
 	struct nbd_config *config;
 	struct nbd_sock *nsock;
+	unsigned int charge;
+	int new_index;
 	int ret;
 
 	if (!refcount_inc_not_zero(&nbd->config_refs)) {
@@ -900,6 +1018,12 @@ static int nbd_handle_cmd(struct nbd_cmd *cmd, int index)
 		return -EINVAL;
 	}
 	cmd->status = BLK_STS_OK;
+	charge = max_t(unsigned int, blk_rq_bytes(req), NBD_MIN_CHARGE);
+	new_index = nbd_pick_sock(nbd, cmd, index, charge, more);
+	if (new_index != index) {
+		atomic64_inc(&config->socks[new_index]->nr_steered);
+		index = new_index;
+	}
 again:
 	nsock = config->socks[index];
 	mutex_lock(&nsock->tx_lock);
@@ -941,13 +1065,22 @@ static int nbd_handle_cmd(struct nbd_cmd *cmd, int index)
 	 * Some failures are related to the link going down, so anything that
 	 * returns EAGAIN can be retried on a different socket.
 	 */
-	ret = nbd_send_cmd(nbd, cmd, index);
+	ret = nbd_send_cmd(nbd, cmd, index, more);
 	if (ret == -EAGAIN) {
 		dev_err_ratelimited(disk_to_dev(nbd->disk),
 				    "Request send failed, requeueing\n");
 		nbd_mark_nsock_dead(nbd, nsock, 1);
 		nbd_requeue_cmd(cmd);
 		ret = 0;
+	} else if (!ret) {
+		/*
+		 * The reply can't be processed before we drop cmd->lock, so
+		 * charging after the send is safe.
+		 */
+		cmd->charge = charge;
+		cmd->send_ns = ktime_get_ns();
+		atomic_inc(&nsock->inflight);
+		atomic_add(charge, &nsock->inflight_bytes);
 	}
 out:
 	mutex_unlock(&nsock->tx_lock);
@@ -978,7 +1111,7 @@ static blk_status_t nbd_queue_rq(struct blk_mq_hw_ctx *hctx,
 	 * this case we need to return that we are busy, otherwise error out as
 	 * appropriate.
 	 */
-	ret = nbd_handle_cmd(cmd, hctx->queue_num);
+	ret = nbd_handle_cmd(cmd, hctx->queue_num, !bd->last);
 	if (ret < 0)
 		ret = BLK_STS_IOERR;
 	else if (!ret)
@@ -1600,6 +1733,53 @@ static const struct file_operations nbd_dbg_flags_ops = {
 	.release = single_release,
 };
 
+static int nbd_dbg_conns_show(struct seq_file *s, void *unused)
+{
+	struct nbd_device *nbd = s->private;
+	struct nbd_config *config;
+	int i;
+
+	seq_puts(s, "conn dead inflight inflight_bytes lat_us sent sent_bytes completed steered\n");
+
+	/*
+	 * config_lock keeps ->socks from being reallocated under us. The config
+	 * itself stays until this file is removed, but that happens with
+	 * config_lock held and waits for us, so don't block on the lock.
+	 */
+	if (!mutex_trylock(&nbd->config_lock))
+		return -EBUSY;
+	config = nbd->config;
+
+	for (i = 0; i < config->num_connections; i++) {
+		struct nbd_sock *nsock = config->socks[i];
+
+		seq_printf(s, "%d %d %d %d %llu %lld %lld %lld %lld\n", i,
+			   READ_ONCE(nsock->dead),
+			   atomic_read(&nsock->inflight),
+			   atomic_read(&nsock->inflight_bytes),
+			   READ_ONCE(nsock->lat_ewma_ns) / NSEC_PER_USEC,
+			   atomic64_read(&nsock->nr_sent),
+			   atomic64_read(&nsock->bytes_sent),
+			   atomic64_read(&nsock->nr_completed),
+			   atomic64_read(&nsock->nr_steered));
+	}
+	mutex_unlock(&nbd->config_lock);
+
+	return 0;
+}
+
+static int nbd_dbg_conns_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nbd_dbg_conns_show, inode->i_private);
+}
+
+static const struct file_operations nbd_dbg_conns_ops = {
+	.open = nbd_dbg_conns_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int nbd_dev_dbg_init(struct nbd_device *nbd)
 {
 	struct dentry *dir;
@@ -1621,6 +1801,7 @@ static int nbd_dev_dbg_init(struct nbd_device *nbd)
 	debugfs_create_u32("timeout", 0444, dir, &nbd->tag_set.timeout);
 	debugfs_create_u64("blocksize", 0444, dir, &config->blksize);
 	debugfs_create_file("flags", 0444, dir, nbd, &nbd_dbg_flags_ops);
+	debugfs_create_file("connections", 0444, dir, nbd, &nbd_dbg_conns_ops);
 
 	return 0;
 }
@@ -31,6 +31,7 @@ struct nullb_queue {
 	unsigned int queue_depth;
 	struct nullb_device *dev;
 	unsigned int requeue_selection;
+	atomic_t inflight; /* timer mode: requests waiting for completion */
 
 	struct nullb_cmd *cmds;
 };
@@ -50,6 +51,14 @@ struct nullb_device {
 
 	unsigned long size; /* device size in MB */
 	unsigned long completion_nsec; /* time in ns to complete a request */
+	/* Timer mode device model, see null_cmd_end_timer() */
+	unsigned long read_nsec; /* base read completion time, 0: completion_nsec */
+	unsigned long write_nsec; /* base write completion time, 0: completion_nsec */
+	unsigned long qd_nsec; /* extra time per request in flight on the queue */
+	unsigned long tail_nsec; /* extra time for tail latency outliers */
+	unsigned long batch_nsec; /* window to coalesce completions in */
+	unsigned int jitter; /* random variation of the base time in percent */
+	unsigned int tail_permille; /* share of requests hitting tail_nsec */
 	unsigned long cache_size; /* disk cache size in MB */
 	unsigned long zone_size; /* zone size in MB if device is zoned */
 	unsigned int zone_nr_conv; /* number of conventional zones */
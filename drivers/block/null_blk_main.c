@@ -9,6 +9,7 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/init.h>
+#include <linux/random.h>
 #include "null_blk.h"
 
 #define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
@@ -299,6 +300,13 @@ NULLB_DEVICE_ATTR(cache_size, ulong);
 NULLB_DEVICE_ATTR(zoned, bool);
 NULLB_DEVICE_ATTR(zone_size, ulong);
 NULLB_DEVICE_ATTR(zone_nr_conv, uint);
+NULLB_DEVICE_ATTR(read_nsec, ulong);
+NULLB_DEVICE_ATTR(write_nsec, ulong);
+NULLB_DEVICE_ATTR(qd_nsec, ulong);
+NULLB_DEVICE_ATTR(jitter, uint);
+NULLB_DEVICE_ATTR(tail_permille, uint);
+NULLB_DEVICE_ATTR(tail_nsec, ulong);
+NULLB_DEVICE_ATTR(batch_nsec, ulong);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -415,6 +423,13 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_zoned,
 	&nullb_device_attr_zone_size,
 	&nullb_device_attr_zone_nr_conv,
+	&nullb_device_attr_read_nsec,
+	&nullb_device_attr_write_nsec,
+	&nullb_device_attr_qd_nsec,
+	&nullb_device_attr_jitter,
+	&nullb_device_attr_tail_permille,
+	&nullb_device_attr_tail_nsec,
+	&nullb_device_attr_batch_nsec,
 	NULL,
 };
 
@@ -633,16 +648,46 @@ static void end_cmd(struct nullb_cmd *cmd)
 
 static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 {
-	end_cmd(container_of(timer, struct nullb_cmd, timer));
+	struct nullb_cmd *cmd = container_of(timer, struct nullb_cmd, timer);
+
+	atomic_dec(&cmd->nq->inflight);
+	end_cmd(cmd);
 
 	return HRTIMER_NORESTART;
 }
 
+/*
+ * Completion time of a request: the base time of its direction, varied
+ * uniformly by +-jitter percent, plus qd_nsec for every other request in
+ * flight on the queue, plus tail_nsec for tail_permille of the requests.
+ * The timers get batch_nsec of slack, so that the hrtimer code completes
+ * the requests falling into the same window from a single interrupt.
+ */
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	ktime_t kt = cmd->nq->dev->completion_nsec;
+	struct nullb_device *dev = cmd->nq->dev;
+	bool write = dev->queue_mode == NULL_Q_BIO ?
+			op_is_write(bio_op(cmd->bio)) :
+			op_is_write(req_op(cmd->rq));
+	u64 base = write ? dev->write_nsec : dev->read_nsec;
+	u64 kt;
+
+	if (!base)
+		base = dev->completion_nsec;
+	kt = base;
+	if (dev->jitter) {
+		u64 span = div_u64(base * dev->jitter, 100);
+
+		kt = base - span +
+		     prandom_u32_max(min_t(u64, 2 * span + 1, U32_MAX));
+	}
+	kt += (u64)dev->qd_nsec * atomic_inc_return(&cmd->nq->inflight) -
+	      dev->qd_nsec;
+	if (dev->tail_permille && prandom_u32_max(1000) < dev->tail_permille)
+		kt += dev->tail_nsec;
 
-	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
+	hrtimer_start_range_ns(&cmd->timer, ns_to_ktime(kt), dev->batch_nsec,
+			       HRTIMER_MODE_REL);
 }
 
 static void null_complete_rq(struct request *rq)
@@ -1462,6 +1507,7 @@ static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 	init_waitqueue_head(&nq->wait);
 	nq->queue_depth = nullb->queue_depth;
 	nq->dev = nullb->dev;
+	atomic_set(&nq->inflight, 0);
 }
 
 static void null_init_queues(struct nullb *nullb)
@@ -1618,6 +1664,8 @@ static int null_validate_conf(struct nullb_device *dev)
 	dev->cache_size = min_t(unsigned long, ULONG_MAX / 1024 / 1024,
 						dev->cache_size);
 	dev->mbps = min_t(unsigned int, 1024 * 40, dev->mbps);
+	dev->jitter = min_t(unsigned int, dev->jitter, 100);
+	dev->tail_permille = min_t(unsigned int, dev->tail_permille, 1000);
 	/* can not stop a queue */
 	if (dev->queue_mode == NULL_Q_BIO)
 		dev->mbps = 0;
@@ -11,6 +11,7 @@
 #include <linux/sched.h>
 #include <linux/cpu.h>
 #include <linux/crypto.h>
+#include <linux/vmalloc.h>
 
 #include "zcomp.h"
 
@@ -32,31 +33,160 @@ static const char * const backends[] = {
 	NULL
 };
 
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+/*
+ * Dictionary compression is meant to get zstd ratios out of single pages,
+ * so favour speed: level 1 with parameters sized for a PAGE_SIZE input.
+ */
+#define ZCOMP_ZSTD_DICT_LEVEL	1
+
+static bool zcomp_has_dict(struct zcomp *comp)
+{
+	return comp->cdict;
+}
+
+static void zcomp_free_dict(struct zcomp *comp)
+{
+	vfree(comp->ddict_wksp);
+	vfree(comp->cdict_wksp);
+}
+
+static int zcomp_init_dict(struct zcomp *comp, const void *dict,
+		size_t dict_sz)
+{
+	size_t sz;
+
+	if (strcmp(comp->name, "zstd"))
+		return -EINVAL;
+
+	comp->params = ZSTD_getParams(ZCOMP_ZSTD_DICT_LEVEL, PAGE_SIZE, dict_sz);
+	/* every page of the device uses the same dictionary */
+	comp->params.fParams.noDictIDFlag = 1;
+
+	sz = ZSTD_CDictWorkspaceBound(comp->params.cParams);
+	comp->cdict_wksp = vzalloc(sz);
+	if (!comp->cdict_wksp)
+		return -ENOMEM;
+	comp->cdict = ZSTD_initCDict(dict, dict_sz, comp->params,
+				     comp->cdict_wksp, sz);
+
+	sz = ZSTD_DDictWorkspaceBound();
+	comp->ddict_wksp = vzalloc(sz);
+	if (!comp->ddict_wksp)
+		return -ENOMEM;
+	comp->ddict = ZSTD_initDDict(dict, dict_sz, comp->ddict_wksp, sz);
+
+	if (!comp->cdict || !comp->ddict)
+		return -EINVAL;
+	return 0;
+}
+
+static void zcomp_strm_free_dict(struct zcomp_strm *zstrm)
+{
+	vfree(zstrm->dctx_wksp);
+	vfree(zstrm->cctx_wksp);
+}
+
+static int zcomp_strm_init_dict(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	size_t sz;
+
+	sz = ZSTD_CCtxWorkspaceBound(comp->params.cParams);
+	zstrm->cctx_wksp = vzalloc(sz);
+	if (!zstrm->cctx_wksp)
+		return -ENOMEM;
+	zstrm->cctx = ZSTD_initCCtx(zstrm->cctx_wksp, sz);
+
+	sz = ZSTD_DCtxWorkspaceBound();
+	zstrm->dctx_wksp = vzalloc(sz);
+	if (!zstrm->dctx_wksp)
+		return -ENOMEM;
+	zstrm->dctx = ZSTD_initDCtx(zstrm->dctx_wksp, sz);
+
+	if (!zstrm->cctx || !zstrm->dctx)
+		return -EINVAL;
+	zstrm->cdict = comp->cdict;
+	zstrm->ddict = comp->ddict;
+	return 0;
+}
+
+static int zcomp_compress_dict(struct zcomp_strm *zstrm,
+		const void *src, unsigned int *dst_len)
+{
+	size_t ret;
+
+	ret = ZSTD_compress_usingCDict(zstrm->cctx, zstrm->buffer, *dst_len,
+				       src, PAGE_SIZE, zstrm->cdict);
+	if (ZSTD_isError(ret))
+		return -EINVAL;
+	*dst_len = ret;
+	return 0;
+}
+
+static int zcomp_decompress_dict(struct zcomp_strm *zstrm,
+		const void *src, unsigned int src_len, void *dst)
+{
+	size_t ret;
+
+	ret = ZSTD_decompress_usingDDict(zstrm->dctx, dst, PAGE_SIZE,
+					 src, src_len, zstrm->ddict);
+	if (ZSTD_isError(ret) || ret != PAGE_SIZE)
+		return -EINVAL;
+	return 0;
+}
+#else
+static bool zcomp_has_dict(struct zcomp *comp) { return false; }
+static void zcomp_free_dict(struct zcomp *comp) {};
+static int zcomp_init_dict(struct zcomp *comp, const void *dict,
+		size_t dict_sz)
+{
+	return -EINVAL;
+}
+static void zcomp_strm_free_dict(struct zcomp_strm *zstrm) {};
+static int zcomp_strm_init_dict(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	return -EINVAL;
+}
+#endif
+
 static void zcomp_strm_free(struct zcomp_strm *zstrm)
 {
 	if (!IS_ERR_OR_NULL(zstrm->tfm))
 		crypto_free_comp(zstrm->tfm);
+	zcomp_strm_free_dict(zstrm);
 	free_pages((unsigned long)zstrm->buffer, 1);
 	kfree(zstrm);
 }
 
 /*
  * allocate new zcomp_strm structure with ->tfm initialized by
- * backend, return NULL on error
+ * backend, or with zstd contexts when the device has a dictionary,
+ * return NULL on error
  */
 static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
 {
-	struct zcomp_strm *zstrm = kmalloc(sizeof(*zstrm), GFP_KERNEL);
+	struct zcomp_strm *zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
 	if (!zstrm)
 		return NULL;
 
-	zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+	if (zcomp_has_dict(comp)) {
+		if (zcomp_strm_init_dict(comp, zstrm)) {
+			zcomp_strm_free(zstrm);
+			return NULL;
+		}
+	} else {
+		zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+		if (IS_ERR(zstrm->tfm)) {
+			zcomp_strm_free(zstrm);
+			return NULL;
+		}
+	}
 	/*
 	 * allocate 2 pages. 1 for compressed data, plus 1 extra for the
 	 * case when compressed size is larger than the original one
 	 */
 	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (IS_ERR_OR_NULL(zstrm->tfm) || !zstrm->buffer) {
+	if (!zstrm->buffer) {
 		zcomp_strm_free(zstrm);
 		zstrm = NULL;
 	}
@@ -140,6 +270,10 @@ int zcomp_compress(struct zcomp_strm *zstrm,
 	 */
 	*dst_len = PAGE_SIZE * 2;
 
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+	if (zstrm->cctx)
+		return zcomp_compress_dict(zstrm, src, dst_len);
+#endif
 	return crypto_comp_compress(zstrm->tfm,
 			src, PAGE_SIZE,
 			zstrm->buffer, dst_len);
@@ -150,6 +284,10 @@ int zcomp_decompress(struct zcomp_strm *zstrm,
 {
 	unsigned int dst_len = PAGE_SIZE;
 
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+	if (zstrm->dctx)
+		return zcomp_decompress_dict(zstrm, src, src_len, dst);
+#endif
 	return crypto_comp_decompress(zstrm->tfm,
 			src, src_len,
 			dst, &dst_len);
@@ -206,6 +344,7 @@ void zcomp_destroy(struct zcomp *comp)
 {
 	cpuhp_state_remove_instance(CPUHP_ZCOMP_PREPARE, &comp->node);
 	free_percpu(comp->stream);
+	zcomp_free_dict(comp);
 	kfree(comp);
 }
 
@@ -216,8 +355,12 @@ void zcomp_destroy(struct zcomp *comp)
  * if requested algorithm is not supported, ERR_PTR(-ENOMEM) in
  * case of allocation error, or any other error potentially
  * returned by zcomp_init().
+ *
+ * A non-empty @dict is digested once and used by every stream; it is
+ * only supported by zstd and must stay around until zcomp_destroy().
  */
-struct zcomp *zcomp_create(const char *compress)
+struct zcomp *zcomp_create(const char *compress, const void *dict,
+		size_t dict_sz)
 {
 	struct zcomp *comp;
 	int error;
@@ -230,10 +373,18 @@ struct zcomp *zcomp_create(const char *compress)
 		return ERR_PTR(-ENOMEM);
 
 	comp->name = compress;
-	error = zcomp_init(comp);
-	if (error) {
-		kfree(comp);
-		return ERR_PTR(error);
+	if (dict_sz) {
+		error = zcomp_init_dict(comp, dict, dict_sz);
+		if (error)
+			goto err;
 	}
+	error = zcomp_init(comp);
+	if (error)
+		goto err;
 	return comp;
+
+err:
+	zcomp_free_dict(comp);
+	kfree(comp);
+	return ERR_PTR(error);
 }
@@ -6,10 +6,23 @@
 #ifndef _ZCOMP_H_
 #define _ZCOMP_H_
 
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+#include <linux/zstd.h>
+#endif
+
 struct zcomp_strm {
 	/* compression/decompression buffer */
 	void *buffer;
 	struct crypto_comp *tfm;
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+	/* per-cpu zstd contexts, only used when a dictionary is loaded */
+	void *cctx_wksp;
+	void *dctx_wksp;
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+	const ZSTD_CDict *cdict;
+	const ZSTD_DDict *ddict;
+#endif
 };
 
 /* dynamic per-device compression frontend */
@@ -17,6 +30,18 @@ struct zcomp {
 	struct zcomp_strm * __percpu *stream;
 	const char *name;
 	struct hlist_node node;
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+	/*
+	 * Digested dictionary, read-only once built and therefore shared
+	 * by all streams. The raw dictionary is owned by the caller and
+	 * must outlive the zcomp.
+	 */
+	ZSTD_parameters params;
+	void *cdict_wksp;
+	void *ddict_wksp;
+	ZSTD_CDict *cdict;
+	ZSTD_DDict *ddict;
+#endif
 };
 
 int zcomp_cpu_up_prepare(unsigned int cpu, struct hlist_node *node);
@@ -24,7 +49,7 @@ int zcomp_cpu_dead(unsigned int cpu, struct hlist_node *node);
 ssize_t zcomp_available_show(const char *comp, char *buf);
 bool zcomp_available_algorithm(const char *comp);
 
-struct zcomp *zcomp_create(const char *comp);
+struct zcomp *zcomp_create(const char *comp, const void *dict, size_t dict_sz);
 void zcomp_destroy(struct zcomp *comp);
 
 struct zcomp_strm *zcomp_stream_get(struct zcomp *comp);
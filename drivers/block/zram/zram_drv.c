@@ -33,6 +33,9 @@
 #include <linux/sysfs.h>
 #include <linux/debugfs.h>
 #include <linux/cpuhotplug.h>
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
 
 #include "zram_drv.h"
 
@@ -1014,6 +1017,98 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+/* trained zstd dictionaries are typically around 100K */
+#define ZRAM_DICT_MAX_SIZE	SZ_1M
+
+static ssize_t comp_dict_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE, "%zu\n", zram->dict_sz);
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t comp_dict_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char *file_name;
+	void *dict = NULL;
+	loff_t dict_sz = 0;
+	size_t sz;
+	int err;
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	/* "none" drops the dictionary */
+	if (strcmp(file_name, "none")) {
+		err = kernel_read_file_from_path(file_name, &dict, &dict_sz,
+						 ZRAM_DICT_MAX_SIZE,
+						 READING_UNKNOWN);
+		if (err)
+			goto out;
+		if (!dict_sz) {
+			err = -EINVAL;
+			goto out;
+		}
+	}
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dictionary for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	swap(zram->dict, dict);
+	zram->dict_sz = dict_sz;
+	up_write(&zram->init_lock);
+
+	pr_info("%s dictionary for %s (%zu bytes)\n",
+		zram->dict ? "Loaded" : "Dropped", zram->disk->disk_name,
+		(size_t)dict_sz);
+	err = len;
+out:
+	vfree(dict);
+	kfree(file_name);
+	return err;
+}
+
+static struct zcomp *zram_comp_create(struct zram *zram)
+{
+	return zcomp_create(zram->compressor, zram->dict, zram->dict_sz);
+}
+
+static void zram_free_dict(struct zram *zram)
+{
+	vfree(zram->dict);
+	zram->dict = NULL;
+	zram->dict_sz = 0;
+}
+#else
+static struct zcomp *zram_comp_create(struct zram *zram)
+{
+	return zcomp_create(zram->compressor, NULL, 0);
+}
+
+static inline void zram_free_dict(struct zram *zram) {};
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1056,6 +1151,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	struct zs_pool_stats pool_stats;
 	u64 orig_size, mem_used = 0;
 	long max_used;
+	u64 compr_size, comp_ratio = 0;
 	ssize_t ret;
 
 	memset(&pool_stats, 0x00, sizeof(struct zs_pool_stats));
@@ -1068,17 +1164,27 @@ static ssize_t mm_stat_show(struct device *dev,
 
 	orig_size = atomic64_read(&zram->stats.pages_stored);
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
+	compr_size = atomic64_read(&zram->stats.compr_data_size);
+	/*
+	 * Achieved ratio of the pages that went through the compressor,
+	 * in hundredths. Same-filled pages take no space and are left out.
+	 */
+	if (compr_size)
+		comp_ratio = div64_u64((orig_size -
+				atomic64_read(&zram->stats.same_pages)) *
+				PAGE_SIZE * 100, compr_size);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
-			(u64)atomic64_read(&zram->stats.compr_data_size),
+			compr_size,
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			atomic_long_read(&pool_stats.pages_compacted),
-			(u64)atomic64_read(&zram->stats.huge_pages));
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			comp_ratio);
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1736,7 +1842,7 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_unlock;
 	}
 
-	comp = zcomp_create(zram->compressor);
+	comp = zram_comp_create(zram);
 	if (IS_ERR(comp)) {
 		pr_err("Cannot initialise %s compressing backend\n",
 				zram->compressor);
@@ -1836,6 +1942,9 @@ static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+static DEVICE_ATTR_RW(comp_dict);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
@@ -1853,6 +1962,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+	&dev_attr_comp_dict.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
@@ -1999,6 +2111,7 @@ static int zram_remove(struct zram *zram)
 	/* Make sure all the pending I/O are finished */
 	sync_blockdev(bdev);
 	zram_reset_device(zram);
+	zram_free_dict(zram);
 	bdput(bdev);
 
 	pr_info("Removed device: %s\n", zram->disk->disk_name);
@@ -121,6 +121,11 @@ struct zram {
 	unsigned long *bitmap;
 	unsigned long nr_pages;
 #endif
+#ifdef CONFIG_ZRAM_ZSTD_DICT
+	/* raw zstd dictionary, referenced by comp while it is initialised */
+	void *dict;
+	size_t dict_sz;
+#endif
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
 #endif
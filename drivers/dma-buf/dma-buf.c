@@ -25,6 +25,8 @@
 #include <linux/mm.h>
 #include <linux/mount.h>
 #include <linux/pseudo_fs.h>
+#include <linux/wait_bit.h>
+#include <linux/workqueue.h>
 
 #include <uapi/linux/dma-buf.h>
 #include <uapi/linux/magic.h>
@@ -38,6 +40,12 @@ struct dma_buf_list {
 
 static struct dma_buf_list db_list;
 
+/* Cached attachment mappings that no importer currently has mapped */
+static atomic_long_t dma_buf_idle_sgts;
+
+/* Idle mappings the shrinker asked to be unmapped */
+static atomic_long_t dma_buf_sgt_reclaim_target;
+
 static char *dmabuffs_dname(struct dentry *dentry, char *buffer, int buflen)
 {
 	struct dma_buf *dmabuf;
@@ -765,6 +773,8 @@ struct dma_buf_attachment *dma_buf_attach(struct dma_buf *dmabuf,
 
 	attach->dev = dev;
 	attach->dmabuf = dmabuf;
+	mutex_init(&attach->sgt_lock);
+	INIT_LIST_HEAD(&attach->sgt_reclaim_node);
 
 	mutex_lock(&dmabuf->lock);
 
@@ -786,6 +796,27 @@ struct dma_buf_attachment *dma_buf_attach(struct dma_buf *dmabuf,
 }
 EXPORT_SYMBOL_GPL(dma_buf_attach);
 
+/* Whether any attachment of @dmabuf may have a cached mapping */
+static bool dma_buf_may_cache_sgt(const struct dma_buf *dmabuf)
+{
+	return dmabuf->ops->cache_sgt_mapping ||
+	       dmabuf->ops->cache_sgt_map_attrs;
+}
+
+/*
+ * Tear down the cached mapping of @attach. Called with @attach->sgt_lock
+ * held, except from dma_buf_detach() once nothing else can reach @attach.
+ */
+static void dma_buf_drop_cached_sgt(struct dma_buf_attachment *attach)
+{
+	if (!attach->sgt_users)
+		atomic_long_dec(&dma_buf_idle_sgts);
+
+	attach->dmabuf->ops->unmap_dma_buf(attach, attach->sgt, attach->dir);
+	attach->sgt = NULL;
+	attach->sgt_users = 0;
+}
+
 /**
  * dma_buf_detach - Remove the given attachment from dmabuf's attachments list;
  * optionally calls detach() of dma_buf_ops for device-specific detach
@@ -799,15 +830,24 @@ void dma_buf_detach(struct dma_buf *dmabuf, struct dma_buf_attachment *attach)
 	if (WARN_ON(!dmabuf || !attach))
 		return;
 
+	/*
+	 * Once off the list reclaim can no longer pick the mapping, but it
+	 * may still be unmapping it.
+	 */
+	mutex_lock(&dmabuf->lock);
+	list_del(&attach->node);
+	mutex_unlock(&dmabuf->lock);
+	wait_var_event(&attach->sgt_reclaim, !READ_ONCE(attach->sgt_reclaim));
+
 	if (attach->sgt)
-		dmabuf->ops->unmap_dma_buf(attach, attach->sgt, attach->dir);
+		dma_buf_drop_cached_sgt(attach);
 
 	mutex_lock(&dmabuf->lock);
-	list_del(&attach->node);
 	if (dmabuf->ops->detach)
 		dmabuf->ops->detach(dmabuf, attach);
 
 	mutex_unlock(&dmabuf->lock);
+	mutex_destroy(&attach->sgt_lock);
 	kfree(attach);
 }
 EXPORT_SYMBOL_GPL(dma_buf_detach);
@@ -826,10 +866,15 @@ EXPORT_SYMBOL_GPL(dma_buf_detach);
  * the underlying backing storage is pinned for as long as a mapping exists,
  * therefore users/importers should not hold onto a mapping for undue amounts of
  * time.
+ *
+ * If dma_buf_attachment_is_cached() is true for @attach, the mapping stays
+ * cached after it has been unmapped and the next call returns it without
+ * mapping the buffer again.
  */
 struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
 					enum dma_data_direction direction)
 {
+	struct dma_buf *dmabuf;
 	struct sg_table *sg_table;
 
 	might_sleep();
@@ -837,27 +882,55 @@ struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
 	if (WARN_ON(!attach || !attach->dmabuf))
 		return ERR_PTR(-EINVAL);
 
+	dmabuf = attach->dmabuf;
+
+	if (!dma_buf_attachment_is_cached(attach)) {
+		atomic_long_inc(&dmabuf->sgt_misses);
+		sg_table = dmabuf->ops->map_dma_buf(attach, direction);
+		return sg_table ?: ERR_PTR(-ENOMEM);
+	}
+
+	mutex_lock(&attach->sgt_lock);
+
 	if (attach->sgt) {
 		/*
 		 * Two mappings with different directions for the same
-		 * attachment are not allowed.
+		 * attachment are not allowed, but an idle cached mapping
+		 * can simply be replaced.
 		 */
 		if (attach->dir != direction &&
-		    attach->dir != DMA_BIDIRECTIONAL)
-			return ERR_PTR(-EBUSY);
+		    attach->dir != DMA_BIDIRECTIONAL) {
+			if (attach->sgt_users) {
+				sg_table = ERR_PTR(-EBUSY);
+				goto out;
+			}
 
-		return attach->sgt;
+			dma_buf_drop_cached_sgt(attach);
+		} else {
+			if (!attach->sgt_users++)
+				atomic_long_dec(&dma_buf_idle_sgts);
+			atomic_long_inc(&dmabuf->sgt_hits);
+			sg_table = attach->sgt;
+			goto sync;
+		}
 	}
 
-	sg_table = attach->dmabuf->ops->map_dma_buf(attach, direction);
+	atomic_long_inc(&dmabuf->sgt_misses);
+	sg_table = dmabuf->ops->map_dma_buf(attach, direction);
 	if (!sg_table)
 		sg_table = ERR_PTR(-ENOMEM);
+	if (IS_ERR(sg_table))
+		goto out;
 
-	if (!IS_ERR(sg_table) && attach->dmabuf->ops->cache_sgt_mapping) {
-		attach->sgt = sg_table;
-		attach->dir = direction;
-	}
+	attach->sgt = sg_table;
+	attach->dir = direction;
+	attach->sgt_users = 1;
 
+sync:
+	if (dmabuf->ops->sync_sg_for_device)
+		dmabuf->ops->sync_sg_for_device(attach, sg_table, attach->dir);
+out:
+	mutex_unlock(&attach->sgt_lock);
 	return sg_table;
 }
 EXPORT_SYMBOL_GPL(dma_buf_map_attachment);
@@ -881,13 +954,161 @@ void dma_buf_unmap_attachment(struct dma_buf_attachment *attach,
 	if (WARN_ON(!attach || !attach->dmabuf || !sg_table))
 		return;
 
-	if (attach->sgt == sg_table)
-		return;
+	/* @attach->dma_map_attrs may have changed since it was mapped */
+	if (dma_buf_may_cache_sgt(attach->dmabuf)) {
+		mutex_lock(&attach->sgt_lock);
+		if (attach->sgt == sg_table) {
+			/* Keep it mapped for the next user */
+			if (attach->dmabuf->ops->sync_sg_for_cpu)
+				attach->dmabuf->ops->sync_sg_for_cpu(attach,
+						sg_table, attach->dir);
+			if (!WARN_ON(!attach->sgt_users) &&
+			    !--attach->sgt_users)
+				atomic_long_inc(&dma_buf_idle_sgts);
+			mutex_unlock(&attach->sgt_lock);
+			return;
+		}
+		mutex_unlock(&attach->sgt_lock);
+	}
 
 	attach->dmabuf->ops->unmap_dma_buf(attach, sg_table, direction);
 }
 EXPORT_SYMBOL_GPL(dma_buf_unmap_attachment);
 
+/*
+ * Unmap up to @nr_to_scan idle cached mappings of @dmabuf and return how many
+ * were unmapped. The attachments are picked under &dma_buf.lock but only
+ * unmapped after dropping it, so the exporter is never called with it held;
+ * @attach->sgt_reclaim keeps dma_buf_detach() from freeing them meanwhile.
+ * Sets *@busy if a mapping was kept because an importer still has it mapped
+ * or because another caller is still unmapping it.
+ */
+static unsigned long dma_buf_drop_idle_sgts(struct dma_buf *dmabuf,
+					    unsigned long nr_to_scan,
+					    bool *busy)
+{
+	struct dma_buf_attachment *attach, *tmp;
+	unsigned long freed = 0;
+	LIST_HEAD(victims);
+
+	mutex_lock(&dmabuf->lock);
+	list_for_each_entry(attach, &dmabuf->attachments, node) {
+		if (nr_to_scan == 0)
+			break;
+
+		if (!READ_ONCE(attach->sgt))
+			continue;
+
+		/* In use, or being unmapped by someone else */
+		if (READ_ONCE(attach->sgt_users) || attach->sgt_reclaim) {
+			*busy = true;
+			continue;
+		}
+
+		attach->sgt_reclaim = true;
+		list_add_tail(&attach->sgt_reclaim_node, &victims);
+		nr_to_scan--;
+	}
+	mutex_unlock(&dmabuf->lock);
+
+	list_for_each_entry_safe(attach, tmp, &victims, sgt_reclaim_node) {
+		mutex_lock(&attach->sgt_lock);
+		if (attach->sgt && !attach->sgt_users) {
+			dma_buf_drop_cached_sgt(attach);
+			freed++;
+		} else if (attach->sgt) {
+			*busy = true;
+		}
+		mutex_unlock(&attach->sgt_lock);
+
+		list_del_init(&attach->sgt_reclaim_node);
+		/* dma_buf_detach() may free @attach once this is clear */
+		smp_store_release(&attach->sgt_reclaim, false);
+		wake_up_var(&attach->sgt_reclaim);
+	}
+
+	return freed;
+}
+
+/*
+ * Exporters may allocate memory with their own locks held while mapping, and
+ * unmapping takes those same locks, so reclaim itself never calls into them.
+ * The shrinker only records how many mappings it wants gone and this work
+ * unmaps them from process context.
+ */
+static void dma_buf_sgt_reclaim_fn(struct work_struct *work)
+{
+	struct dma_buf *dmabuf;
+	unsigned long target, freed = 0;
+	bool busy = false;
+
+	target = atomic_long_xchg(&dma_buf_sgt_reclaim_target, 0);
+
+	/* db_list.lock keeps every listed buffer alive */
+	mutex_lock(&db_list.lock);
+	list_for_each_entry(dmabuf, &db_list.head, list_node) {
+		if (freed >= target)
+			break;
+
+		if (dma_buf_may_cache_sgt(dmabuf))
+			freed += dma_buf_drop_idle_sgts(dmabuf, target - freed,
+							&busy);
+	}
+	mutex_unlock(&db_list.lock);
+}
+
+static DECLARE_WORK(dma_buf_sgt_reclaim_work, dma_buf_sgt_reclaim_fn);
+
+/**
+ * dma_buf_invalidate_mappings - drop the cached mappings of a buffer
+ * @dmabuf:	[in]	buffer whose backing storage is about to change.
+ *
+ * For exporters caching mappings, see &dma_buf_ops.cache_sgt_mapping, e.g.
+ * before moving the backing storage: unmaps every cached attachment mapping
+ * no importer currently has mapped, so that the next dma_buf_map_attachment()
+ * maps the buffer again. Waits for the shrinker work to finish unmapping, so must not
+ * be called with &dma_buf.lock or any lock @unmap_dma_buf takes held.
+ *
+ * Returns 0 once no cached mapping is left, or -EBUSY if some are still in
+ * use or still being unmapped and were kept.
+ */
+int dma_buf_invalidate_mappings(struct dma_buf *dmabuf)
+{
+	bool busy = false;
+
+	if (WARN_ON(!dmabuf))
+		return -EINVAL;
+
+	/* Let reclaim that already picked a mapping finish unmapping it */
+	flush_work(&dma_buf_sgt_reclaim_work);
+	dma_buf_drop_idle_sgts(dmabuf, ULONG_MAX, &busy);
+
+	return busy ? -EBUSY : 0;
+}
+EXPORT_SYMBOL_GPL(dma_buf_invalidate_mappings);
+
+static unsigned long dma_buf_sgt_count(struct shrinker *shrinker,
+				       struct shrink_control *sc)
+{
+	return atomic_long_read(&dma_buf_idle_sgts);
+}
+
+static unsigned long dma_buf_sgt_scan(struct shrinker *shrinker,
+				      struct shrink_control *sc)
+{
+	atomic_long_add(sc->nr_to_scan, &dma_buf_sgt_reclaim_target);
+	queue_work(system_unbound_wq, &dma_buf_sgt_reclaim_work);
+
+	/* Nothing is freed synchronously */
+	return SHRINK_STOP;
+}
+
+static struct shrinker dma_buf_sgt_shrinker = {
+	.count_objects = dma_buf_sgt_count,
+	.scan_objects = dma_buf_sgt_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 /**
  * DOC: cpu access
  *
@@ -1378,8 +1599,11 @@ static int dma_buf_debug_show(struct seq_file *s, void *unused)
 			attach_count++;
 		}
 
-		seq_printf(s, "Total %d devices attached\n\n",
+		seq_printf(s, "Total %d devices attached\n",
 				attach_count);
+		seq_printf(s, "Mapping cache: %ld hits, %ld misses\n\n",
+			   atomic_long_read(&buf_obj->sgt_hits),
+			   atomic_long_read(&buf_obj->sgt_misses));
 
 		dma_buf_ref_show(s, to_msm_dma_buf(buf_obj));
 
@@ -1437,12 +1661,21 @@ static inline void dma_buf_uninit_debugfs(void)
 
 static int __init dma_buf_init(void)
 {
+	int ret;
+
 	dma_buf_mnt = kern_mount(&dma_buf_fs_type);
 	if (IS_ERR(dma_buf_mnt))
 		return PTR_ERR(dma_buf_mnt);
 
 	mutex_init(&db_list.lock);
 	INIT_LIST_HEAD(&db_list.head);
+
+	ret = register_shrinker(&dma_buf_sgt_shrinker);
+	if (ret) {
+		kern_unmount(dma_buf_mnt);
+		return ret;
+	}
+
 	dma_buf_init_debugfs();
 	return 0;
 }
@@ -1451,6 +1684,8 @@ subsys_initcall(dma_buf_init);
 static void __exit dma_buf_deinit(void)
 {
 	dma_buf_uninit_debugfs();
+	unregister_shrinker(&dma_buf_sgt_shrinker);
+	cancel_work_sync(&dma_buf_sgt_reclaim_work);
 	kern_unmount(dma_buf_mnt);
 }
 __exitcall(dma_buf_deinit);
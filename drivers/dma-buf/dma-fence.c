@@ -11,6 +11,7 @@
  */
 
 #include <linux/slab.h>
+#include <linux/mm.h>
 #include <linux/export.h>
 #include <linux/atomic.h>
 #include <linux/dma-fence.h>
@@ -513,82 +514,131 @@ dma_fence_default_wait(struct dma_fence *fence, bool intr, signed long timeout)
 }
 EXPORT_SYMBOL(dma_fence_default_wait);
 
-static bool
-dma_fence_test_signaled_any(struct dma_fence **fences, uint32_t count,
-			    uint32_t *idx)
+struct dma_fence_wait_many {
+	struct task_struct *task;
+	atomic_t pending;
+	uint32_t first;
+};
+
+struct dma_fence_wait_many_cb {
+	struct dma_fence_cb base;
+	struct dma_fence_wait_many *wait;
+	struct dma_fence *fence;
+	uint32_t idx;
+};
+
+static void
+dma_fence_wait_many_cb(struct dma_fence *fence, struct dma_fence_cb *cb)
 {
-	int i;
+	struct dma_fence_wait_many_cb *wait_cb =
+		container_of(cb, struct dma_fence_wait_many_cb, base);
+	struct dma_fence_wait_many *wait = wait_cb->wait;
 
-	for (i = 0; i < count; ++i) {
-		struct dma_fence *fence = fences[i];
-		if (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags)) {
-			if (idx)
-				*idx = i;
-			return true;
-		}
-	}
-	return false;
+	cmpxchg(&wait->first, U32_MAX, wait_cb->idx);
+	if (atomic_dec_and_test(&wait->pending))
+		wake_up_state(wait->task, TASK_NORMAL);
 }
 
 /**
- * dma_fence_wait_any_timeout - sleep until any fence gets signaled
+ * dma_fence_wait_many_timeout - sleep until any or all fences are signaled
  * or until timeout elapses
  * @fences: array of fences to wait on
  * @count: number of fences to wait on
+ * @wait_all: if true, wait for all fences, otherwise for the first one
  * @intr: if true, do an interruptible wait
  * @timeout: timeout value in jiffies, or MAX_SCHEDULE_TIMEOUT
- * @idx: used to store the first signaled fence index, meaningful only on
- *	positive return
+ * @idx: used to store the first signaled fence index when not waiting for
+ *	all fences, meaningful only on positive return
  *
- * Returns -EINVAL on custom fence wait implementation, -ERESTARTSYS if
- * interrupted, 0 if the wait timed out, or the remaining timeout in jiffies
- * on success.
+ * Returns -ERESTARTSYS if interrupted, -ENOMEM if out of memory, 0 if the
+ * wait timed out, or the remaining timeout in jiffies on success.
  *
- * Synchronous waits for the first fence in the array to be signaled. The
- * caller needs to hold a reference to all fences in the array, otherwise a
- * fence might be freed before return, resulting in undefined behavior.
+ * Fences from the same context signal in seqno order, so only one callback
+ * is installed per context: on the earliest unsignaled fence when waiting
+ * for any, on the latest when waiting for all. The callbacks share a single
+ * pending count and only wake the waiter once the wait condition is met,
+ * rather than on every fence that signals.
  *
- * See also dma_fence_wait() and dma_fence_wait_timeout().
+ * The caller needs to hold a reference to all fences in the array, otherwise
+ * a fence might be freed before return, resulting in undefined behavior.
+ *
+ * See also dma_fence_wait_any_timeout().
  */
 signed long
-dma_fence_wait_any_timeout(struct dma_fence **fences, uint32_t count,
-			   bool intr, signed long timeout, uint32_t *idx)
+dma_fence_wait_many_timeout(struct dma_fence **fences, uint32_t count,
+			    bool wait_all, bool intr, signed long timeout,
+			    uint32_t *idx)
 {
-	struct default_wait_cb *cb;
+	struct dma_fence_wait_many wait = {
+		.task = current,
+		.first = U32_MAX,
+	};
+	struct dma_fence_wait_many_cb *cb;
 	signed long ret = timeout;
-	unsigned i;
+	uint32_t i, j, nr = 0;
 
 	if (WARN_ON(!fences || !count || timeout < 0))
 		return -EINVAL;
 
 	if (timeout == 0) {
-		for (i = 0; i < count; ++i)
-			if (dma_fence_is_signaled(fences[i])) {
+		for (i = 0; i < count; ++i) {
+			bool signaled = dma_fence_is_signaled(fences[i]);
+
+			if (wait_all && !signaled)
+				return 0;
+
+			if (!wait_all && signaled) {
 				if (idx)
 					*idx = i;
 				return 1;
 			}
+		}
 
-		return 0;
+		return wait_all;
 	}
 
-	cb = kcalloc(count, sizeof(struct default_wait_cb), GFP_KERNEL);
-	if (cb == NULL) {
-		ret = -ENOMEM;
-		goto err_free_cb;
-	}
+	cb = kvcalloc(count, sizeof(*cb), GFP_KERNEL);
+	if (cb == NULL)
+		return -ENOMEM;
 
 	for (i = 0; i < count; ++i) {
 		struct dma_fence *fence = fences[i];
 
-		cb[i].task = current;
-		if (dma_fence_add_callback(fence, &cb[i].base,
-					   dma_fence_default_wait_cb)) {
-			/* This fence is already signaled */
+		if (dma_fence_is_signaled(fence)) {
+			if (wait_all)
+				continue;
+
 			if (idx)
 				*idx = i;
-			goto fence_rm_cb;
+			goto out;
 		}
+
+		/* Arrays are expected to span only a handful of contexts */
+		for (j = 0; j < nr; ++j)
+			if (cb[j].fence->context == fence->context)
+				break;
+
+		if (j == nr)
+			nr++;
+		else if (__dma_fence_is_later(fence->seqno, cb[j].fence->seqno,
+					      fence->ops) != wait_all)
+			continue;
+
+		cb[j].fence = fence;
+		cb[j].idx = i;
+	}
+
+	if (!nr)
+		goto out;
+
+	atomic_set(&wait.pending, wait_all ? nr : 1);
+
+	for (i = 0; i < nr && atomic_read(&wait.pending) > 0; ++i) {
+		cb[i].wait = &wait;
+		if (dma_fence_add_callback(cb[i].fence, &cb[i].base,
+					   dma_fence_wait_many_cb))
+			/* This fence is already signaled */
+			dma_fence_wait_many_cb(cb[i].fence, &cb[i].base);
 	}
 
 	while (ret > 0) {
@@ -597,7 +647,7 @@ dma_fence_wait_any_timeout(struct dma_fence **fences, uint32_t count,
 		else
 			set_current_state(TASK_UNINTERRUPTIBLE);
 
-		if (dma_fence_test_signaled_any(fences, count, idx))
+		if (atomic_read(&wait.pending) <= 0)
 			break;
 
 		ret = schedule_timeout(ret);
@@ -608,15 +658,46 @@ dma_fence_wait_any_timeout(struct dma_fence **fences, uint32_t count,
 
 	__set_current_state(TASK_RUNNING);
 
-fence_rm_cb:
 	while (i-- > 0)
-		dma_fence_remove_callback(fences[i], &cb[i].base);
+		dma_fence_remove_callback(cb[i].fence, &cb[i].base);
 
-err_free_cb:
-	kfree(cb);
+	if (ret > 0 && !wait_all && idx)
+		*idx = wait.first;
+
+out:
+	kvfree(cb);
 
 	return ret;
 }
+EXPORT_SYMBOL(dma_fence_wait_many_timeout);
+
+/**
+ * dma_fence_wait_any_timeout - sleep until any fence gets signaled
+ * or until timeout elapses
+ * @fences: array of fences to wait on
+ * @count: number of fences to wait on
+ * @intr: if true, do an interruptible wait
+ * @timeout: timeout value in jiffies, or MAX_SCHEDULE_TIMEOUT
+ * @idx: used to store the first signaled fence index, meaningful only on
+ *	positive return
+ *
+ * Returns -EINVAL on custom fence wait implementation, -ERESTARTSYS if
+ * interrupted, 0 if the wait timed out, or the remaining timeout in jiffies
+ * on success.
+ *
+ * Synchronous waits for the first fence in the array to be signaled. The
+ * caller needs to hold a reference to all fences in the array, otherwise a
+ * fence might be freed before return, resulting in undefined behavior.
+ *
+ * See also dma_fence_wait() and dma_fence_wait_timeout().
+ */
+signed long
+dma_fence_wait_any_timeout(struct dma_fence **fences, uint32_t count,
+			   bool intr, signed long timeout, uint32_t *idx)
+{
+	return dma_fence_wait_many_timeout(fences, count, false, intr,
+					   timeout, idx);
+}
 EXPORT_SYMBOL(dma_fence_wait_any_timeout);
 
 /**
@@ -9,6 +9,7 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
@@ -156,47 +157,31 @@ static struct dma_fence **get_fences(struct sync_file *sync_file,
 	return &sync_file->fence;
 }
 
-static void add_fence(struct dma_fence **fences,
-		      int *i, struct dma_fence *fence)
+static void add_fence(struct dma_fence **fences, int *i, int *kept,
+		      struct dma_fence *fence)
 {
-	fences[*i] = fence;
+	if (dma_fence_is_signaled(fence))
+		return;
 
-	if (!dma_fence_is_signaled(fence)) {
-		dma_fence_get(fence);
-		(*i)++;
-	}
+	if (fences)
+		fences[*i] = dma_fence_get(fence);
+	(*i)++;
+	(*kept)++;
 }
 
-/**
- * sync_file_merge() - merge two sync_files
- * @name:	name of new fence
- * @a:		sync_file a
- * @b:		sync_file b
- *
- * Creates a new sync_file which contains copies of all the fences in both
- * @a and @b.  @a and @b remain valid, independent sync_file. Returns the
- * new merged sync_file or NULL in case of error.
+/*
+ * Collect the fences the merge of @a_fences and @b_fences needs: the latest
+ * fence of every context, minus the ones that have already signaled. With
+ * @fences NULL they are only counted. @a_kept and @b_kept return how many of
+ * them came from either side.
  */
-static struct sync_file *sync_file_merge(struct sync_file *a, struct sync_file *b)
+static int merge_fences(struct dma_fence **a_fences, int a_num_fences,
+			struct dma_fence **b_fences, int b_num_fences,
+			struct dma_fence **fences, int *a_kept, int *b_kept)
 {
-	struct sync_file *sync_file;
-	struct dma_fence **fences = NULL, **nfences, **a_fences, **b_fences;
-	int i = 0, i_a, i_b, num_fences, a_num_fences, b_num_fences;
-
-	sync_file = sync_file_alloc();
-	if (!sync_file)
-		return NULL;
-
-	a_fences = get_fences(a, &a_num_fences);
-	b_fences = get_fences(b, &b_num_fences);
-	if (a_num_fences > INT_MAX - b_num_fences)
-		goto err;
-
-	num_fences = a_num_fences + b_num_fences;
+	int i = 0, i_a, i_b;
 
-	fences = kcalloc(num_fences, sizeof(*fences), GFP_KERNEL);
-	if (!fences)
-		goto err;
+	*a_kept = *b_kept = 0;
 
 	/*
 	 * Assume sync_file a and b are both ordered and have no
@@ -210,19 +195,20 @@ static struct sync_file *sync_file_merge(struct sync_file *a, struct sync_file *
 		struct dma_fence *pt_b = b_fences[i_b];
 
 		if (pt_a->context < pt_b->context) {
-			add_fence(fences, &i, pt_a);
+			add_fence(fences, &i, a_kept, pt_a);
 
 			i_a++;
 		} else if (pt_a->context > pt_b->context) {
-			add_fence(fences, &i, pt_b);
+			add_fence(fences, &i, b_kept, pt_b);
 
 			i_b++;
 		} else {
-			if (__dma_fence_is_later(pt_a->seqno, pt_b->seqno,
+			/* On a tie keep a's fence, so that a can be reused */
+			if (__dma_fence_is_later(pt_b->seqno, pt_a->seqno,
 						 pt_a->ops))
-				add_fence(fences, &i, pt_a);
+				add_fence(fences, &i, b_kept, pt_b);
 			else
-				add_fence(fences, &i, pt_b);
+				add_fence(fences, &i, a_kept, pt_a);
 
 			i_a++;
 			i_b++;
@@ -230,21 +216,85 @@ static struct sync_file *sync_file_merge(struct sync_file *a, struct sync_file *
 	}
 
 	for (; i_a < a_num_fences; i_a++)
-		add_fence(fences, &i, a_fences[i_a]);
+		add_fence(fences, &i, a_kept, a_fences[i_a]);
 
 	for (; i_b < b_num_fences; i_b++)
-		add_fence(fences, &i, b_fences[i_b]);
+		add_fence(fences, &i, b_kept, b_fences[i_b]);
+
+	return i;
+}
+
+/**
+ * sync_file_merge() - merge two sync_files
+ * @name:	name of new fence
+ * @a:		sync_file a
+ * @b:		sync_file b
+ *
+ * Creates a new sync_file which contains copies of all the fences in both
+ * @a and @b.  @a and @b remain valid, independent sync_file. Returns the
+ * new merged sync_file or NULL in case of error.
+ *
+ * Only the latest fence of each context is kept and signaled fences are
+ * dropped. When the result is exactly the fence of @a or @b, that fence is
+ * shared instead of building a new array.
+ */
+static struct sync_file *sync_file_merge(struct sync_file *a, struct sync_file *b)
+{
+	struct sync_file *sync_file;
+	struct dma_fence **fences = NULL, **a_fences, **b_fences;
+	struct dma_fence *fence = NULL;
+	int i = 0, num_fences, a_num_fences, b_num_fences, a_kept, b_kept;
+
+	sync_file = sync_file_alloc();
+	if (!sync_file)
+		return NULL;
+
+	a_fences = get_fences(a, &a_num_fences);
+	b_fences = get_fences(b, &b_num_fences);
+	if (a_num_fences > INT_MAX - b_num_fences)
+		goto err;
+
+	/* Size the result up front rather than over-allocating and shrinking */
+	num_fences = merge_fences(a_fences, a_num_fences, b_fences,
+				  b_num_fences, NULL, &a_kept, &b_kept);
+
+	if (!b_kept && a_kept == a_num_fences) {
+		fence = a->fence;
+		goto reuse;
+	}
 
-	if (i == 0)
-		fences[i++] = dma_fence_get(a_fences[0]);
+	if (!a_kept && b_kept == b_num_fences) {
+		fence = b->fence;
+		goto reuse;
+	}
+
+	/* Everything has signaled: any signaled fence will do */
+	if (!num_fences) {
+		fence = a->fence;
+		goto reuse;
+	}
 
-	if (num_fences > i) {
-		nfences = krealloc(fences, i * sizeof(*fences),
-				  GFP_KERNEL);
-		if (!nfences)
+	if (num_fences == 1) {
+		fences = &fence;
+	} else {
+		fences = kcalloc(num_fences, sizeof(*fences), GFP_KERNEL);
+		if (!fences)
 			goto err;
+	}
 
-		fences = nfences;
+	/*
+	 * Fences can only signal between the two passes, so this fills in at
+	 * most num_fences entries.
+	 */
+	i = merge_fences(a_fences, a_num_fences, b_fences, b_num_fences,
+			 fences, &a_kept, &b_kept);
+
+	if (i <= 1) {
+		fence = i ? fences[0] : dma_fence_get(a->fence);
+		if (fences != &fence)
+			kfree(fences);
+		sync_file->fence = fence;
+		return sync_file;
 	}
 
 	if (sync_file_set_fence(sync_file, fences, i) < 0)
@@ -252,10 +302,15 @@ static struct sync_file *sync_file_merge(struct sync_file *a, struct sync_file *
 
 	return sync_file;
 
+reuse:
+	sync_file->fence = dma_fence_get(fence);
+	return sync_file;
+
 err:
 	while (i)
 		dma_fence_put(fences[--i]);
-	kfree(fences);
+	if (fences != &fence)
+		kfree(fences);
 	fput(sync_file->file);
 	return NULL;
 
@@ -424,6 +479,92 @@ static long sync_file_ioctl_fence_info(struct sync_file *sync_file,
 	return 0;
 }
 
+/*
+ * Upper bound on the fds accepted by SYNC_IOC_WAIT. Each one pins a fence
+ * and a wait callback for the duration of the call, so the array can't be
+ * left for userspace to size.
+ */
+#define SYNC_WAIT_MAX_FDS	4096
+
+static long sync_file_ioctl_wait(struct sync_file *sync_file,
+				 unsigned long arg)
+{
+	struct sync_wait_data data;
+	struct dma_fence **fences;
+	s32 __user *ufds, *ustatus;
+	signed long timeout;
+	u32 i, n = 0, first = 0;
+	long ret;
+
+	if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+		return -EFAULT;
+
+	if ((data.flags & ~SYNC_WAIT_ALL) || data.pad || !data.num_fds ||
+	    data.num_fds > SYNC_WAIT_MAX_FDS)
+		return -EINVAL;
+
+	fences = kvmalloc_array(data.num_fds, sizeof(*fences), GFP_KERNEL);
+	if (!fences)
+		return -ENOMEM;
+
+	ufds = u64_to_user_ptr(data.fds);
+	for (n = 0; n < data.num_fds; n++) {
+		s32 fd;
+
+		if (get_user(fd, ufds + n)) {
+			ret = -EFAULT;
+			goto err_put_fences;
+		}
+
+		fences[n] = sync_file_get_fence(fd);
+		if (!fences[n]) {
+			ret = -ENOENT;
+			goto err_put_fences;
+		}
+	}
+
+	if (data.timeout_ns < 0) {
+		timeout = MAX_SCHEDULE_TIMEOUT;
+	} else {
+		timeout = min_t(u64, nsecs_to_jiffies64(data.timeout_ns),
+				MAX_SCHEDULE_TIMEOUT - 1);
+		/* Don't let a short timeout turn into a poll */
+		if (data.timeout_ns && !timeout)
+			timeout = 1;
+	}
+
+	ret = dma_fence_wait_many_timeout(fences, n,
+					  data.flags & SYNC_WAIT_ALL, true,
+					  timeout, &first);
+	if (ret < 0)
+		goto err_put_fences;
+
+	ustatus = u64_to_user_ptr(data.status);
+	if (ustatus) {
+		for (i = 0; i < n; i++) {
+			if (put_user(dma_fence_get_status(fences[i]),
+				     ustatus + i)) {
+				ret = -EFAULT;
+				goto err_put_fences;
+			}
+		}
+	}
+
+	data.first_signaled = ret && !(data.flags & SYNC_WAIT_ALL) ? first : 0;
+	if (copy_to_user((void __user *)arg, &data, sizeof(data))) {
+		ret = -EFAULT;
+		goto err_put_fences;
+	}
+
+	ret = ret ? 0 : -ETIME;
+
+err_put_fences:
+	while (n--)
+		dma_fence_put(fences[n]);
+	kvfree(fences);
+	return ret;
+}
+
 static long sync_file_ioctl(struct file *file, unsigned int cmd,
 			    unsigned long arg)
 {
@@ -436,6 +577,9 @@ static long sync_file_ioctl(struct file *file, unsigned int cmd,
 	case SYNC_IOC_FILE_INFO:
 		return sync_file_ioctl_fence_info(sync_file, arg);
 
+	case SYNC_IOC_WAIT:
+		return sync_file_ioctl_wait(sync_file, arg);
+
 	default:
 		return -ENOTTY;
 	}
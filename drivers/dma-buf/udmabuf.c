@@ -3,6 +3,7 @@
 #include <linux/device.h>
 #include <linux/dma-buf.h>
 #include <linux/highmem.h>
+#include <linux/hugetlb.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/memfd.h>
@@ -119,6 +120,41 @@ static const struct dma_buf_ops udmabuf_ops = {
 	.mmap		  = mmap_udmabuf,
 };
 
+/*
+ * Look up and pin page @idx of @memfd. @nr returns how many pages, starting
+ * with the returned one, are backed by the same huge page, so the caller can
+ * take them all from this single lookup.
+ */
+static struct page *udmabuf_get_page(struct file *memfd, pgoff_t idx,
+				     pgoff_t *nr)
+{
+	struct address_space *mapping = file_inode(memfd)->i_mapping;
+	struct page *page, *head;
+
+	if (is_file_hugepages(memfd)) {
+		struct hstate *h = hstate_file(memfd);
+		pgoff_t subpg = idx & (pages_per_huge_page(h) - 1);
+
+		/* hugetlbfs indexes its page cache in huge page units */
+		head = find_get_page_flags(mapping, idx >> huge_page_order(h),
+					   FGP_ACCESSED);
+		if (!head)
+			return ERR_PTR(-EINVAL);
+
+		*nr = pages_per_huge_page(h) - subpg;
+		return nth_page(head, subpg);
+	}
+
+	page = shmem_read_mapping_page(mapping, idx);
+	if (IS_ERR(page))
+		return page;
+
+	/* Transparent huge pages come back as the subpage for @idx */
+	head = compound_head(page);
+	*nr = hpage_nr_pages(head) - (page - head);
+	return page;
+}
+
 #define SEALS_WANTED (F_SEAL_SHRINK)
 #define SEALS_DENIED (F_SEAL_WRITE)
 
@@ -129,7 +165,7 @@ static long udmabuf_create(const struct udmabuf_create_list *head,
 	struct file *memfd = NULL;
 	struct udmabuf *ubuf;
 	struct dma_buf *buf;
-	pgoff_t pgoff, pgcnt, pgidx, pgbuf = 0, pglimit;
+	pgoff_t pgoff, pgcnt, pgidx, pgbuf = 0, pglimit, nr, k;
 	struct page *page;
 	int seals, ret = -EINVAL;
 	u32 i, flags;
@@ -165,7 +201,8 @@ static long udmabuf_create(const struct udmabuf_create_list *head,
 		memfd = fget(list[i].memfd);
 		if (!memfd)
 			goto err;
-		if (!shmem_mapping(file_inode(memfd)->i_mapping))
+		if (!shmem_mapping(file_inode(memfd)->i_mapping) &&
+		    !is_file_hugepages(memfd))
 			goto err;
 		seals = memfd_fcntl(memfd, F_GET_SEALS, 0);
 		if (seals == -EINVAL)
@@ -176,14 +213,18 @@ static long udmabuf_create(const struct udmabuf_create_list *head,
 			goto err;
 		pgoff = list[i].offset >> PAGE_SHIFT;
 		pgcnt = list[i].size   >> PAGE_SHIFT;
-		for (pgidx = 0; pgidx < pgcnt; pgidx++) {
-			page = shmem_read_mapping_page(
-				file_inode(memfd)->i_mapping, pgoff + pgidx);
+		for (pgidx = 0; pgidx < pgcnt; pgidx += nr) {
+			page = udmabuf_get_page(memfd, pgoff + pgidx, &nr);
 			if (IS_ERR(page)) {
 				ret = PTR_ERR(page);
 				goto err;
 			}
-			ubuf->pages[pgbuf++] = page;
+			nr = min(nr, pgcnt - pgidx);
+
+			/* release_udmabuf() drops one reference per page */
+			page_ref_add(compound_head(page), nr - 1);
+			for (k = 0; k < nr; k++)
+				ubuf->pages[pgbuf++] = nth_page(page, k);
 		}
 		fput(memfd);
 		memfd = NULL;
@@ -387,6 +387,18 @@ struct cached_dev {
 	unsigned int		writeback_rate_p_term_inverse;
 	unsigned int		writeback_rate_minimum;
 
+	/*
+	 * Latency feedback: foreground reads that go to the backing device
+	 * are timed, and while their mean latency over an update interval
+	 * is above writeback_rate_latency_target (usec, 0 disables) the
+	 * writeback rate is scaled down by writeback_rate_latency_scale.
+	 */
+	unsigned int		writeback_rate_latency_target;
+	unsigned int		writeback_rate_latency_scale;
+	unsigned int		backing_read_latency;
+	atomic64_t		backing_read_latency_sum;
+	atomic_t		backing_read_count;
+
 	enum stop_on_failure	stop_when_cache_set_failed;
 #define DEFAULT_CACHED_DEV_ERROR_LIMIT	64
 	atomic_t		io_errors;
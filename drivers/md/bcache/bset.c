@@ -947,6 +947,13 @@ static struct bset_search_iter bset_search_write_set(struct bset_tree *t,
 	while (li + 1 != ri) {
 		unsigned int m = (li + ri) >> 1;
 
+		/*
+		 * Whichever way we go, the next probe is one of these two keys:
+		 * start pulling both in while we compare against this one.
+		 */
+		prefetch(table_to_bkey(t, (li + m) >> 1));
+		prefetch(table_to_bkey(t, (m + ri) >> 1));
+
 		if (bkey_cmp(table_to_bkey(t, m), search) > 0)
 			ri = m;
 		else
@@ -975,17 +982,15 @@ static struct bset_search_iter bset_search_tree(struct bset_tree *t,
 		j = n;
 		f = &t->tree[j];
 
-		if (likely(f->exponent != 127)) {
-			if (f->mantissa >= bfloat_mantissa(search, f))
-				n = j * 2;
-			else
-				n = j * 2 + 1;
-		} else {
-			if (bkey_cmp(tree_to_bkey(t, j), search) > 0)
-				n = j * 2;
-			else
-				n = j * 2 + 1;
-		}
+		/*
+		 * Which child we descend to is effectively random, so compute
+		 * it rather than branch on it - a mispredict here costs more
+		 * than the comparison itself.
+		 */
+		if (likely(f->exponent != 127))
+			n = j * 2 + (f->mantissa < bfloat_mantissa(search, f));
+		else
+			n = j * 2 + (bkey_cmp(tree_to_bkey(t, j), search) <= 0);
 	} while (n < t->size);
 
 	inorder = to_inorder(j, t);
@@ -1109,6 +1114,7 @@ static struct bkey *__bch_btree_iter_init(struct btree_keys *b,
 					  struct bkey *search,
 					  struct bset_tree *start)
 {
+	struct bset_tree *t;
 	struct bkey *ret = NULL;
 
 	iter->size = ARRAY_SIZE(iter->data);
@@ -1118,6 +1124,17 @@ static struct bkey *__bch_btree_iter_init(struct btree_keys *b,
 	iter->b = b;
 #endif
 
+	/*
+	 * The searches below are independent of each other, so get the
+	 * cache misses on the top of every auxiliary tree and the first key
+	 * of every set going in parallel rather than taking them one set
+	 * at a time.
+	 */
+	for (t = start; t <= bset_tree_last(b); t++) {
+		prefetch(t->tree);
+		prefetch(t->data->start);
+	}
+
 	for (; start <= bset_tree_last(b); start++) {
 		ret = bch_bset_search(b, start, search);
 		bch_btree_iter_push(iter, ret, bset_bkey_last(start->data));
@@ -15,6 +15,7 @@
 #include <linux/debugfs.h>
 #include <linux/module.h>
 #include <linux/random.h>
+#include <linux/sched/clock.h>
 #include <linux/seq_file.h>
 
 struct dentry *bcache_debug;
@@ -244,6 +245,97 @@ void bch_debug_init_cache_set(struct cache_set *c)
 	}
 }
 
+#ifdef CONFIG_BCACHE_DEBUG
+
+/*
+ * Lookup microbenchmark: fill a btree node sized bset with extents, build its
+ * auxiliary search tree and time random lookups against it, i.e. the cached
+ * random read case where bcache is bound by btree lookups rather than IO.
+ */
+
+#define BSET_BENCH_NODE_BYTES	(256 << 10)
+#define BSET_BENCH_SEARCHES	(1 << 14)
+#define BSET_BENCH_ROUNDS	64
+
+static int bch_bset_bench_show(struct seq_file *m, void *data)
+{
+	struct btree_keys *b;
+	struct bset *i;
+	struct bkey *search;
+	bool expensive_checks = false;
+	unsigned int nr_keys, n, round;
+	unsigned long found = 0;
+	u64 start, ns, lookups;
+	int ret = -ENOMEM;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+
+	search = kvmalloc_array(BSET_BENCH_SEARCHES, sizeof(*search),
+				GFP_KERNEL);
+	if (!search)
+		goto err;
+
+	bch_btree_keys_init(b, &bch_extent_keys_ops, &expensive_checks);
+	if (bch_btree_keys_alloc(b, get_order(BSET_BENCH_NODE_BYTES),
+				 GFP_KERNEL))
+		goto err;
+
+	i = b->set->data;
+	bch_bset_init_next(b, i, 0);
+
+	for (nr_keys = 0; bch_btree_keys_u64s_remaining(b) >= BKEY_U64S;
+	     nr_keys++) {
+		*bset_bkey_last(i) = KEY(0, (nr_keys + 1) * 8, 8);
+		i->keys += BKEY_U64S;
+	}
+
+	bch_bset_build_written_tree(b);
+
+	for (n = 0; n < BSET_BENCH_SEARCHES; n++)
+		search[n] = KEY(0, prandom_u32_max(nr_keys * 8), 0);
+
+	start = local_clock();
+	for (round = 0; round < BSET_BENCH_ROUNDS; round++)
+		for (n = 0; n < BSET_BENCH_SEARCHES; n++)
+			found += bch_bset_search(b, b->set, &search[n]) !=
+				bset_bkey_last(i);
+	ns = max_t(u64, local_clock() - start, 1);
+
+	lookups = (u64) BSET_BENCH_SEARCHES * BSET_BENCH_ROUNDS;
+
+	seq_printf(m, "keys:\t\t%u\n", nr_keys);
+	seq_printf(m, "tree nodes:\t%u\n", b->set->size);
+	seq_printf(m, "lookups:\t%llu\n", lookups);
+	seq_printf(m, "found:\t\t%lu\n", found);
+	seq_printf(m, "ns/lookup:\t%llu\n", div64_u64(ns, lookups));
+	seq_printf(m, "lookups/sec:\t%llu\n",
+		   div64_u64(lookups * NSEC_PER_SEC, ns));
+
+	bch_btree_keys_free(b);
+	ret = 0;
+err:
+	kvfree(search);
+	kfree(b);
+	return ret;
+}
+
+static int bch_bset_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bch_bset_bench_show, NULL);
+}
+
+static const struct file_operations bset_bench_ops = {
+	.owner		= THIS_MODULE,
+	.open		= bch_bset_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+#endif
+
 #endif
 
 void bch_debug_exit(void)
@@ -259,4 +351,9 @@ void __init bch_debug_init(void)
 	 * about this.
 	 */
 	bcache_debug = debugfs_create_dir("bcache", NULL);
+
+#if defined(CONFIG_DEBUG_FS) && defined(CONFIG_BCACHE_DEBUG)
+	debugfs_create_file("bset_bench", 0400, bcache_debug, NULL,
+			    &bset_bench_ops);
+#endif
 }
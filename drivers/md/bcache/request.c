@@ -488,6 +488,9 @@ struct search {
 	unsigned int		cache_missed:1;
 
 	unsigned long		start_time;
+	/* For backing device read latency sampling, see backing_read_submit() */
+	struct bio		*lat_bio;
+	u64			start_ns;
 
 	struct btree_op		op;
 	struct data_insert_op	iop;
@@ -648,11 +651,10 @@ static void request_endio(struct bio *bio)
 static void backing_request_endio(struct bio *bio)
 {
 	struct closure *cl = bio->bi_private;
+	struct search *s = container_of(cl, struct search, cl);
+	struct cached_dev *dc = container_of(s->d, struct cached_dev, disk);
 
 	if (bio->bi_status) {
-		struct search *s = container_of(cl, struct search, cl);
-		struct cached_dev *dc = container_of(s->d,
-						     struct cached_dev, disk);
 		/*
 		 * If a bio has REQ_PREFLUSH for writeback mode, it is
 		 * speically assembled in cached_dev_write() for a non-zero
@@ -671,6 +673,11 @@ static void backing_request_endio(struct bio *bio)
 		s->recoverable = false;
 		/* should count I/O error for backing device here */
 		bch_count_backing_io_errors(dc, bio);
+	} else if (bio == s->lat_bio && dc->writeback_rate_latency_target) {
+		/* Feeds the writeback rate latency controller */
+		atomic64_add(local_clock() - s->start_ns,
+			     &dc->backing_read_latency_sum);
+		atomic_inc(&dc->backing_read_count);
 	}
 
 	bio_put(bio);
@@ -710,6 +717,32 @@ static void do_bio_hook(struct search *s,
 	bio_cnt_set(bio, 3);
 }
 
+/*
+ * Send a read to the backing device. The first one of a request is timed from
+ * here to backing_request_endio(), which leaves out the btree lookup and any
+ * earlier attempt to read from the cache. The timed bio is held until the
+ * search is done so that no later split can show up at the same address.
+ */
+static void backing_read_submit(struct search *s, struct bio *bio,
+				struct closure *cl)
+{
+	if (!s->lat_bio) {
+		bio_get(bio);
+		s->lat_bio = bio;
+		s->start_ns = local_clock();
+	}
+
+	closure_bio_submit(s->iop.c, bio, cl);
+}
+
+static void backing_read_reset(struct search *s)
+{
+	if (s->lat_bio) {
+		bio_put(s->lat_bio);
+		s->lat_bio = NULL;
+	}
+}
+
 static void search_free(struct closure *cl)
 {
 	struct search *s = container_of(cl, struct search, cl);
@@ -718,6 +751,7 @@ static void search_free(struct closure *cl)
 
 	if (s->iop.bio)
 		bio_put(s->iop.bio);
+	backing_read_reset(s);
 
 	bio_complete(s);
 	closure_debug_destroy(cl);
@@ -743,6 +777,7 @@ static inline struct search *search_alloc(struct bio *bio,
 	s->write		= op_is_write(bio_op(bio));
 	s->read_dirty_data	= 0;
 	s->start_time		= jiffies;
+	s->lat_bio		= NULL;
 
 	s->iop.c		= d->c;
 	s->iop.bio		= NULL;
@@ -800,12 +835,13 @@ static void cached_dev_read_error(struct closure *cl)
 		trace_bcache_read_retry(s->orig_bio);
 
 		s->iop.status = 0;
+		backing_read_reset(s);
 		do_bio_hook(s, s->orig_bio, backing_request_endio);
 
 		/* XXX: invalidate cache */
 
 		/* I/O request sent to backing device */
-		closure_bio_submit(s->iop.c, bio, cl);
+		backing_read_submit(s, bio, cl);
 	}
 
 	continue_at(cl, cached_dev_read_error_done, NULL);
@@ -948,7 +984,7 @@ static int cached_dev_cache_miss(struct btree *b, struct search *s,
 	s->iop.bio	= cache_bio;
 	bio_get(cache_bio);
 	/* I/O request sent to backing device */
-	closure_bio_submit(s->iop.c, cache_bio, &s->cl);
+	backing_read_submit(s, cache_bio, &s->cl);
 
 	return ret;
 out_put:
@@ -957,7 +993,7 @@ static int cached_dev_cache_miss(struct btree *b, struct search *s,
 	miss->bi_end_io		= backing_request_endio;
 	miss->bi_private	= &s->cl;
 	/* I/O request sent to backing device */
-	closure_bio_submit(s->iop.c, miss, &s->cl);
+	backing_read_submit(s, miss, &s->cl);
 	return ret;
 }
 
@@ -118,6 +118,7 @@ rw_attribute(writeback_rate_update_seconds);
 rw_attribute(writeback_rate_i_term_inverse);
 rw_attribute(writeback_rate_p_term_inverse);
 rw_attribute(writeback_rate_minimum);
+rw_attribute(writeback_rate_latency_target);
 read_attribute(writeback_rate_debug);
 
 read_attribute(stripe_size);
@@ -201,6 +202,7 @@ SHOW(__bch_cached_dev)
 	var_print(writeback_rate_i_term_inverse);
 	var_print(writeback_rate_p_term_inverse);
 	var_print(writeback_rate_minimum);
+	var_print(writeback_rate_latency_target);
 
 	if (attr == &sysfs_writeback_rate_debug) {
 		char rate[20];
@@ -210,6 +212,8 @@ SHOW(__bch_cached_dev)
 		char integral[20];
 		char change[20];
 		s64 next_io;
+		unsigned int scale = wb ? dc->writeback_rate_latency_scale
+					: WRITEBACK_LATENCY_SCALE_MAX;
 
 		/*
 		 * Except for dirty and target, other values should
@@ -235,9 +239,12 @@ SHOW(__bch_cached_dev)
 			       "proportional:\t%s\n"
 			       "integral:\t%s\n"
 			       "change:\t\t%s/sec\n"
+			       "read latency:\t%uus\n"
+			       "latency scale:\t%u/%u\n"
 			       "next io:\t%llims\n",
 			       rate, dirty, target, proportional,
-			       integral, change, next_io);
+			       integral, change, dc->backing_read_latency,
+			       scale, WRITEBACK_LATENCY_SCALE_MAX, next_io);
 	}
 
 	sysfs_hprint(dirty_data,
@@ -329,6 +336,9 @@ STORE(__cached_dev)
 	sysfs_strtoul_clamp(writeback_rate_minimum,
 			    dc->writeback_rate_minimum,
 			    1, UINT_MAX);
+	sysfs_strtoul_clamp(writeback_rate_latency_target,
+			    dc->writeback_rate_latency_target,
+			    0, UINT_MAX);
 
 	sysfs_strtoul_clamp(io_error_limit, dc->error_limit, 0, INT_MAX);
 
@@ -498,6 +508,7 @@ static struct attribute *bch_cached_dev_files[] = {
 	&sysfs_writeback_rate_i_term_inverse,
 	&sysfs_writeback_rate_p_term_inverse,
 	&sysfs_writeback_rate_minimum,
+	&sysfs_writeback_rate_latency_target,
 	&sysfs_writeback_rate_debug,
 	&sysfs_io_errors,
 	&sysfs_io_error_limit,
@@ -58,6 +58,41 @@ static uint64_t __calc_target_rate(struct cached_dev *dc)
 	return (cache_dirty_target * bdev_share) >> WRITEBACK_SHARE_SHIFT;
 }
 
+/*
+ * Backing device latency feedback.
+ *
+ * The dirty data controller below only looks at how much dirty data there
+ * is, so a writeback burst is free to saturate the backing device and make
+ * foreground reads that miss the cache wait behind it. To avoid that, the
+ * mean latency of those reads over the last update interval is compared to
+ * writeback_rate_latency_target: while it is above target the rate is cut
+ * in proportion to the overshoot (multiplicative decrease), and once it is
+ * back under target the rate recovers by 1/8th per interval.
+ */
+static void __update_writeback_latency(struct cached_dev *dc)
+{
+	uint64_t sum = atomic64_xchg(&dc->backing_read_latency_sum, 0);
+	unsigned int nr = atomic_xchg(&dc->backing_read_count, 0);
+	unsigned int target = dc->writeback_rate_latency_target;
+	unsigned int scale = dc->writeback_rate_latency_scale;
+	uint64_t latency;
+
+	latency = nr ? div_u64(div_u64(sum, nr), NSEC_PER_USEC) : 0;
+	dc->backing_read_latency = min_t(uint64_t, latency, UINT_MAX);
+
+	if (!target)
+		scale = WRITEBACK_LATENCY_SCALE_MAX;
+	else if (latency > target)
+		scale = max_t(uint64_t, div64_u64((uint64_t) scale * target,
+						  latency), 1);
+	else
+		scale = min_t(unsigned int, scale +
+			      (WRITEBACK_LATENCY_SCALE_MAX >> 3),
+			      WRITEBACK_LATENCY_SCALE_MAX);
+
+	dc->writeback_rate_latency_scale = scale;
+}
+
 static void __update_writeback_rate(struct cached_dev *dc)
 {
 	/*
@@ -88,9 +123,17 @@ static void __update_writeback_rate(struct cached_dev *dc)
 	int64_t integral_scaled;
 	uint32_t new_rate;
 
+	__update_writeback_latency(dc);
+
+	/*
+	 * While writeback is being held back for the sake of foreground
+	 * latency the device "keeping up" with the reduced rate says nothing
+	 * about the real rate, so don't wind up the integral then either.
+	 */
 	if ((error < 0 && dc->writeback_rate_integral > 0) ||
 	    (error > 0 && time_before64(local_clock(),
-			 dc->writeback_rate.next + NSEC_PER_MSEC))) {
+			 dc->writeback_rate.next + NSEC_PER_MSEC) &&
+	     dc->writeback_rate_latency_scale == WRITEBACK_LATENCY_SCALE_MAX)) {
 		/*
 		 * Only decrease the integral term if it's more than
 		 * zero.  Only increase the integral term if the device
@@ -110,6 +153,10 @@ static void __update_writeback_rate(struct cached_dev *dc)
 
 	new_rate = clamp_t(int32_t, (proportional_scaled + integral_scaled),
 			dc->writeback_rate_minimum, NSEC_PER_SEC);
+	new_rate = max_t(uint32_t, ((uint64_t) new_rate *
+			 dc->writeback_rate_latency_scale) >>
+			 WRITEBACK_LATENCY_SCALE_SHIFT,
+			 dc->writeback_rate_minimum);
 
 	dc->writeback_rate_proportional = proportional_scaled;
 	dc->writeback_rate_integral_scaled = integral_scaled;
@@ -855,6 +902,10 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_rate_update_seconds = WRITEBACK_RATE_UPDATE_SECS_DEFAULT;
 	dc->writeback_rate_p_term_inverse = 40;
 	dc->writeback_rate_i_term_inverse = 10000;
+	dc->writeback_rate_latency_target = 0;
+	dc->writeback_rate_latency_scale = WRITEBACK_LATENCY_SCALE_MAX;
+	atomic64_set(&dc->backing_read_latency_sum, 0);
+	atomic_set(&dc->backing_read_count, 0);
 
 	WARN_ON(test_and_clear_bit(BCACHE_DEV_WB_RUNNING, &dc->disk.flags));
 	INIT_DELAYED_WORK(&dc->writeback_rate_update, update_writeback_rate);
@@ -23,6 +23,10 @@
  */
 #define WRITEBACK_SHARE_SHIFT   14
 
+/* writeback_rate_latency_scale is a fraction of 1 << this */
+#define WRITEBACK_LATENCY_SCALE_SHIFT	10
+#define WRITEBACK_LATENCY_SCALE_MAX	(1 << WRITEBACK_LATENCY_SCALE_SHIFT)
+
 static inline uint64_t bcache_dev_sectors_dirty(struct bcache_device *d)
 {
 	uint64_t i, ret = 0;
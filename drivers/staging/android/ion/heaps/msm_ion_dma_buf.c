@@ -95,6 +95,8 @@ struct msm_ion_dma_buf_attachment {
 	struct sg_table *table;
 	struct list_head list;
 	bool dma_mapped;
+	bool sgt_cached;
+	bool cpu_sync;
 };
 
 static int msm_ion_dma_buf_attach(struct dma_buf *dmabuf,
@@ -180,20 +182,30 @@ static struct sg_table
 		return ERR_PTR(-EINVAL);
 	}
 
-	if (map_attrs & DMA_ATTR_SKIP_CPU_SYNC)
+	a->sgt_cached = dma_buf_attachment_is_cached(attachment);
+	if (a->sgt_cached) {
+		/*
+		 * dma-buf keeps this mapping across importer map/unmap calls,
+		 * so the CMOs are done and traced by msm_ion_sync_sg_for_*().
+		 */
+		a->cpu_sync = !(map_attrs & (DMA_ATTR_SKIP_CPU_SYNC |
+					     DMA_ATTR_FORCE_COHERENT));
+		map_attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+	} else if (map_attrs & DMA_ATTR_SKIP_CPU_SYNC) {
 		trace_ion_dma_map_cmo_skip(attachment->dev,
 					   ino,
 					   ion_buffer_cached(buffer),
 					   hlos_accessible_buffer(buffer),
 					   attachment->dma_map_attrs,
 					   direction);
-	else
+	} else {
 		trace_ion_dma_map_cmo_apply(attachment->dev,
 					    ino,
 					    ion_buffer_cached(buffer),
 					    hlos_accessible_buffer(buffer),
 					    attachment->dma_map_attrs,
 					    direction);
+	}
 
 	if (map_attrs & DMA_ATTR_DELAYED_UNMAP) {
 		count = msm_dma_map_sg_attrs(attachment->dev, table->sgl,
@@ -255,7 +267,9 @@ static void msm_ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
 	    dev_is_dma_coherent_hint_cached(attachment->dev))
 		map_attrs |= DMA_ATTR_FORCE_COHERENT;
 
-	if (map_attrs & DMA_ATTR_SKIP_CPU_SYNC)
+	if (a->sgt_cached)
+		map_attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+	else if (map_attrs & DMA_ATTR_SKIP_CPU_SYNC)
 		trace_ion_dma_unmap_cmo_skip(attachment->dev,
 					     ino,
 					     ion_buffer_cached(buffer),
@@ -282,6 +296,62 @@ static void msm_ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
 	mutex_unlock(&buffer->lock);
 }
 
+static void msm_ion_sync_sg_for_device(struct dma_buf_attachment *attachment,
+				       struct sg_table *table,
+				       enum dma_data_direction direction)
+{
+	struct msm_ion_dma_buf_attachment *a = attachment->priv;
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+	unsigned long ino = file_inode(attachment->dmabuf->file)->i_ino;
+
+	if (!a->cpu_sync) {
+		trace_ion_dma_map_cmo_skip(attachment->dev,
+					   ino,
+					   ion_buffer_cached(buffer),
+					   hlos_accessible_buffer(buffer),
+					   attachment->dma_map_attrs,
+					   direction);
+		return;
+	}
+
+	trace_ion_dma_map_cmo_apply(attachment->dev,
+				    ino,
+				    ion_buffer_cached(buffer),
+				    hlos_accessible_buffer(buffer),
+				    attachment->dma_map_attrs,
+				    direction);
+	dma_sync_sg_for_device(attachment->dev, table->sgl, table->nents,
+			       direction);
+}
+
+static void msm_ion_sync_sg_for_cpu(struct dma_buf_attachment *attachment,
+				    struct sg_table *table,
+				    enum dma_data_direction direction)
+{
+	struct msm_ion_dma_buf_attachment *a = attachment->priv;
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+	unsigned long ino = file_inode(attachment->dmabuf->file)->i_ino;
+
+	if (!a->cpu_sync) {
+		trace_ion_dma_unmap_cmo_skip(attachment->dev,
+					     ino,
+					     ion_buffer_cached(buffer),
+					     hlos_accessible_buffer(buffer),
+					     attachment->dma_map_attrs,
+					     direction);
+		return;
+	}
+
+	trace_ion_dma_unmap_cmo_apply(attachment->dev,
+				      ino,
+				      ion_buffer_cached(buffer),
+				      hlos_accessible_buffer(buffer),
+				      attachment->dma_map_attrs,
+				      direction);
+	dma_sync_sg_for_cpu(attachment->dev, table->sgl, table->nents,
+			    direction);
+}
+
 void ion_pages_sync_for_device(struct device *dev, struct page *page,
 			       size_t size, enum dma_data_direction dir)
 {
@@ -811,6 +881,8 @@ static int msm_ion_dma_buf_get_flags(struct dma_buf *dmabuf,
 const struct dma_buf_ops msm_ion_dma_buf_ops = {
 	.map_dma_buf = msm_ion_map_dma_buf,
 	.unmap_dma_buf = msm_ion_unmap_dma_buf,
+	.sync_sg_for_device = msm_ion_sync_sg_for_device,
+	.sync_sg_for_cpu = msm_ion_sync_sg_for_cpu,
 	.mmap = msm_ion_mmap,
 	.release = msm_ion_dma_buf_release,
 	.attach = msm_ion_dma_buf_attach,
@@ -113,7 +113,9 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 	a = attachment->priv;
 	table = a->table;
 
-	if (!(buffer->flags & ION_FLAG_CACHED))
+	/* A cached mapping gets its CMOs from ion_dma_buf_sync_sg_for_*() */
+	if (!(buffer->flags & ION_FLAG_CACHED) ||
+	    dma_buf_attachment_is_cached(attachment))
 		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
 
 	if (!dma_map_sg_attrs(attachment->dev, table->sgl, table->nents,
@@ -140,13 +142,46 @@ static void ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
 
 	a->mapped = false;
 
-	if (!(buffer->flags & ION_FLAG_CACHED))
+	if (!(buffer->flags & ION_FLAG_CACHED) ||
+	    dma_buf_attachment_is_cached(attachment))
 		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
 
 	dma_unmap_sg_attrs(attachment->dev, table->sgl, table->nents,
 			   direction, attrs);
 }
 
+static void ion_dma_buf_sync_sg_for_device(struct dma_buf_attachment *attachment,
+					   struct sg_table *table,
+					   enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+	struct ion_heap *heap = buffer->heap;
+
+	if (heap->buf_ops.sync_sg_for_device)
+		return heap->buf_ops.sync_sg_for_device(attachment, table,
+							direction);
+
+	if (buffer->flags & ION_FLAG_CACHED)
+		dma_sync_sg_for_device(attachment->dev, table->sgl,
+				       table->nents, direction);
+}
+
+static void ion_dma_buf_sync_sg_for_cpu(struct dma_buf_attachment *attachment,
+					struct sg_table *table,
+					enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+	struct ion_heap *heap = buffer->heap;
+
+	if (heap->buf_ops.sync_sg_for_cpu)
+		return heap->buf_ops.sync_sg_for_cpu(attachment, table,
+						     direction);
+
+	if (buffer->flags & ION_FLAG_CACHED)
+		dma_sync_sg_for_cpu(attachment->dev, table->sgl,
+				    table->nents, direction);
+}
+
 static void ion_dma_buf_release(struct dma_buf *dmabuf)
 {
 	struct ion_buffer *buffer = dmabuf->priv;
@@ -338,10 +373,13 @@ static int ion_dma_buf_get_flags(struct dma_buf *dmabuf, unsigned long *flags)
 }
 
 static const struct dma_buf_ops dma_buf_ops = {
+	.cache_sgt_map_attrs = DMA_ATTR_DELAYED_UNMAP,
 	.attach = ion_dma_buf_attach,
 	.detach = ion_dma_buf_detatch,
 	.map_dma_buf = ion_map_dma_buf,
 	.unmap_dma_buf = ion_unmap_dma_buf,
+	.sync_sg_for_device = ion_dma_buf_sync_sg_for_device,
+	.sync_sg_for_cpu = ion_dma_buf_sync_sg_for_cpu,
 	.release = ion_dma_buf_release,
 	.begin_cpu_access = ion_dma_buf_begin_cpu_access,
 	.begin_cpu_access_partial = ion_dma_buf_begin_cpu_access_partial,
@@ -40,9 +40,33 @@ struct dma_buf_ops {
 	  * If true the framework will cache the first mapping made for each
 	  * attachment. This avoids creating mappings for attachments multiple
 	  * times.
+	  *
+	  * The cached mapping outlives dma_buf_unmap_attachment(). It is only
+	  * torn down on detach, when the system is short on memory, when it
+	  * is idle and mapped again with an incompatible direction, or when
+	  * the exporter calls dma_buf_invalidate_mappings().
+	  *
+	  * Exporters caching mappings, through this or through
+	  * @cache_sgt_map_attrs, must cope with @unmap_dma_buf being called
+	  * on an idle mapping at any time, from a workqueue under memory
+	  * pressure and without &dma_buf.lock held. Since a cached mapping is
+	  * handed out again without calling @map_dma_buf, CPU cache
+	  * maintenance belongs in @sync_sg_for_device and @sync_sg_for_cpu
+	  * rather than in @map_dma_buf and @unmap_dma_buf.
 	  */
 	bool cache_sgt_mapping;
 
+	/**
+	  * @cache_sgt_map_attrs:
+	  *
+	  * Lets importers opt in to @cache_sgt_mapping one attachment at a
+	  * time: when non-zero, the mapping of an attachment whose
+	  * &dma_buf_attachment.dma_map_attrs contain all of these DMA
+	  * attributes is cached under the same rules. Other attachments are
+	  * mapped and unmapped on every call as usual.
+	  */
+	unsigned long cache_sgt_map_attrs;
+
 	/**
 	 * @attach:
 	 *
@@ -135,6 +159,31 @@ struct dma_buf_ops {
 			      struct sg_table *,
 			      enum dma_data_direction);
 
+	/**
+	 * @sync_sg_for_device:
+	 *
+	 * Only used for attachments whose mapping is cached, see
+	 * @cache_sgt_mapping. Called from dma_buf_map_attachment() every
+	 * time an importer maps the attachment, whether the mapping
+	 * was cached or just created, to make the buffer visible to the
+	 * device. This is optional.
+	 */
+	void (*sync_sg_for_device)(struct dma_buf_attachment *,
+				   struct sg_table *,
+				   enum dma_data_direction);
+
+	/**
+	 * @sync_sg_for_cpu:
+	 *
+	 * Only used for attachments whose mapping is cached, see
+	 * @cache_sgt_mapping. Called from dma_buf_unmap_attachment() every
+	 * time an importer unmaps the attachment, while the mapping itself
+	 * stays cached. This is optional.
+	 */
+	void (*sync_sg_for_cpu)(struct dma_buf_attachment *,
+				struct sg_table *,
+				enum dma_data_direction);
+
 	/* TODO: Add try_map_dma_buf version, to return immed with -EBUSY
 	 * if the call would block.
 	 */
@@ -382,6 +431,8 @@ typedef int (*dma_buf_destructor)(struct dma_buf *dmabuf, void *dtor_data);
  * @poll: for userspace poll support
  * @cb_excl: for userspace poll support
  * @cb_shared: for userspace poll support
+ * @sgt_hits: dma_buf_map_attachment() calls served from a cached mapping
+ * @sgt_misses: dma_buf_map_attachment() calls that had to map the buffer
  *
  * This represents a shared buffer, created by calling dma_buf_export(). The
  * userspace representation is a normal file descriptor, which can be created by
@@ -421,6 +472,9 @@ struct dma_buf {
 
 		__poll_t active;
 	} cb_excl, cb_shared;
+
+	atomic_long_t sgt_hits;
+	atomic_long_t sgt_misses;
 };
 
 /**
@@ -443,6 +497,11 @@ struct msm_dma_buf {
  * @node: list of dma_buf_attachment.
  * @sgt: cached mapping.
  * @dir: direction of cached mapping.
+ * @sgt_lock: protects @sgt, @dir and @sgt_users.
+ * @sgt_users: number of importer mappings of @sgt not yet unmapped.
+ * @sgt_reclaim: set, under &dma_buf.lock, while the idle mapping is being
+ * reclaimed; dma_buf_detach() waits for it to clear.
+ * @sgt_reclaim_node: entry in the list of mappings being reclaimed.
  * @priv: exporter specific attachment data.
  * @dma_map_attrs: DMA attributes to be used when the exporter maps the buffer
  * through dma_buf_map_attachment.
@@ -462,10 +521,33 @@ struct dma_buf_attachment {
 	struct list_head node;
 	struct sg_table *sgt;
 	enum dma_data_direction dir;
+	struct mutex sgt_lock;
+	unsigned int sgt_users;
+	bool sgt_reclaim;
+	struct list_head sgt_reclaim_node;
 	void *priv;
 	unsigned long dma_map_attrs;
 };
 
+/**
+ * dma_buf_attachment_is_cached - whether the mapping of @attach is cached
+ * @attach:	[in]	attachment to check
+ *
+ * True if dma_buf_unmap_attachment() keeps the mapping of @attach around for
+ * the next dma_buf_map_attachment(), see &dma_buf_ops.cache_sgt_mapping and
+ * &dma_buf_ops.cache_sgt_map_attrs.
+ */
+static inline bool
+dma_buf_attachment_is_cached(const struct dma_buf_attachment *attach)
+{
+	const struct dma_buf_ops *ops = attach->dmabuf->ops;
+
+	return ops->cache_sgt_mapping ||
+	       (ops->cache_sgt_map_attrs &&
+		(attach->dma_map_attrs & ops->cache_sgt_map_attrs) ==
+			ops->cache_sgt_map_attrs);
+}
+
 /**
  * struct dma_buf_export_info - holds information needed to export a dma_buf
  * @exp_name:	name of the exporter - useful for debugging.
@@ -537,6 +619,7 @@ struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *,
 					enum dma_data_direction);
 void dma_buf_unmap_attachment(struct dma_buf_attachment *, struct sg_table *,
 				enum dma_data_direction);
+int dma_buf_invalidate_mappings(struct dma_buf *dmabuf);
 int dma_buf_begin_cpu_access(struct dma_buf *dma_buf,
 			     enum dma_data_direction dir);
 int dma_buf_begin_cpu_access_partial(struct dma_buf *dma_buf,
@@ -541,6 +541,10 @@ signed long dma_fence_wait_any_timeout(struct dma_fence **fences,
 				       uint32_t count,
 				       bool intr, signed long timeout,
 				       uint32_t *idx);
+signed long dma_fence_wait_many_timeout(struct dma_fence **fences,
+					uint32_t count, bool wait_all,
+					bool intr, signed long timeout,
+					uint32_t *idx);
 
 /**
  * dma_fence_wait - sleep until the fence gets signaled
@@ -170,6 +170,8 @@ struct ip_set_type_variant {
 
 	/* When adding entries and set is full, try to resize the set */
 	int (*resize)(struct ip_set *set, bool retried);
+	/* Before adding a batch of entries, make room for them at once */
+	int (*reserve)(struct ip_set *set, u32 nelems);
 	/* Destroy the set */
 	void (*destroy)(struct ip_set *set);
 	/* Flush the elements */
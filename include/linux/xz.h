@@ -233,6 +233,27 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s);
  */
 XZ_EXTERN void xz_dec_end(struct xz_dec *s);
 
+/**
+ * xz_dec_mt_run() - Decode a whole .xz Stream using several threads
+ * @b:          Input and output buffers
+ * @max_threads: Maximum number of threads to use including the caller,
+ *              or 0 to use one per online CPU
+ *
+ * This is a single-call decoder like xz_dec_run() in XZ_SINGLE mode and
+ * the same rules apply to @b: b->in must hold one complete Stream, the
+ * output space must be large enough for all of it, and on failure
+ * b->in_pos and b->out_pos are left unchanged. If the Stream has more than
+ * one Block, the Index is read first to find where each Block starts in
+ * the input and output, and the Blocks are then decoded in parallel on
+ * system_unbound_wq. Streams with a single Block, a Check type other than
+ * CRC32 or none, or trailing Stream Padding are decoded sequentially.
+ *
+ * Available when CONFIG_XZ_DEC_MT is enabled. Returns XZ_STREAM_END on
+ * success, XZ_MEM_ERROR if allocating the decoder states fails, and
+ * otherwise the same error codes as xz_dec_run().
+ */
+XZ_EXTERN enum xz_ret xz_dec_mt_run(struct xz_buf *b, unsigned int max_threads);
+
 /*
  * Standalone build (userspace build or in-kernel build for boot time use)
  * needs a CRC32 implementation. For normal in-kernel use, kernel's own
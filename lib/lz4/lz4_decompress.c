@@ -106,6 +106,31 @@ LZ4_wildCopy32(void *dstPtr, const void *srcPtr, void *dstEnd)
 	} while (d < e);
 }
 
+/* expand a short-offset match from a 16-byte copy of its period,
+ * which can overwrite up to 15 bytes beyond dstEnd.
+ * each store advances by the largest multiple of offset that fits in 16 bytes
+ * so the pattern stays in phase, and unlike an overlapping LZ4_wildCopy8()
+ * no load has to wait for the previous store to land. */
+FORCE_O2_INLINE_GCC_PPC64LE void
+LZ4_memcpy_using_pattern(BYTE *dstPtr, const BYTE *srcPtr, BYTE *dstEnd,
+			 const size_t offset)
+{
+	const size_t step = 16 - (16 % offset);
+	BYTE v[16];
+	size_t i;
+
+	/* only offset bytes of the source precede dstPtr */
+	for (i = 0; i < offset; i++)
+		v[i] = srcPtr[i];
+	for (; i < 16; i++)
+		v[i] = v[i - offset];
+
+	do {
+		LZ4_memcpy(dstPtr, v, 16);
+		dstPtr += step;
+	} while (dstPtr < dstEnd);
+}
+
 FORCE_O2_INLINE_GCC_PPC64LE void
 LZ4_memcpy_using_offset(BYTE *dstPtr, const BYTE *srcPtr, BYTE *dstEnd,
 			const size_t offset)
@@ -125,18 +150,26 @@ LZ4_memcpy_using_offset(BYTE *dstPtr, const BYTE *srcPtr, BYTE *dstEnd,
 		LZ4_memcpy(v, srcPtr, 4);
 		LZ4_memcpy(&v[4], srcPtr, 4);
 		goto copy_loop;
+	case 8:
+		LZ4_memcpy(v, srcPtr, 8);
+		goto copy_loop;
+	case 3:
+	case 5 ... 7:
+	case 9 ... 15:
+		LZ4_memcpy_using_pattern(dstPtr, srcPtr, dstEnd, offset);
+		return;
 	default:
 		LZ4_memcpy_using_offset_base(dstPtr, srcPtr, dstEnd, offset);
 		return;
 	}
 
       copy_loop:
-	LZ4_memcpy(dstPtr, v, 8);
-	dstPtr += 8;
-	while (dstPtr < dstEnd) {
+	/* the pattern repeats every 8 bytes, store it 16 bytes at a time */
+	do {
 		LZ4_memcpy(dstPtr, v, 8);
-		dstPtr += 8;
-	}
+		LZ4_memcpy(dstPtr + 8, v, 8);
+		dstPtr += 16;
+	} while (dstPtr < dstEnd);
 }
 #endif
 
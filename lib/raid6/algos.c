@@ -18,6 +18,9 @@
 #else
 #include <linux/module.h>
 #include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
 #if !RAID6_USE_EMPTY_ZERO_PAGE
 /* In .bss so it's zeroed */
 const char raid6_empty_zero_page[PAGE_SIZE] __attribute__((aligned(256)));
@@ -28,6 +31,46 @@ EXPORT_SYMBOL(raid6_empty_zero_page);
 struct raid6_calls raid6_call;
 EXPORT_SYMBOL_GPL(raid6_call);
 
+/*
+ * raid6_pq.algo= names the gen_syndrome() routine set to use, which skips
+ * the benchmark entirely. Reading it back gives the set in use.
+ */
+static char raid6_algo_name[16];
+
+/* Benchmark after init, starting with the preferred valid routine set */
+static bool raid6_async_bench;
+
+/* Results of the last benchmark, 0 if none was run */
+static unsigned long raid6_gen_mbps, raid6_xor_mbps;
+
+#ifdef __KERNEL__
+static int raid6_algo_get(char *buf, const struct kernel_param *kp)
+{
+	const char *name = READ_ONCE(raid6_call.name);
+
+	return sprintf(buf, "%s\n", name ? name : raid6_algo_name);
+}
+
+static const struct kernel_param_ops raid6_algo_ops = {
+	.set = param_set_copystring,
+	.get = raid6_algo_get,
+};
+
+static struct kparam_string raid6_algo_kps = {
+	.string = raid6_algo_name,
+	.maxlen = sizeof(raid6_algo_name),
+};
+
+module_param_cb(algo, &raid6_algo_ops, &raid6_algo_kps, 0444);
+MODULE_PARM_DESC(algo, "gen_syndrome() algorithm to use without benchmarking");
+module_param_named(async_bench, raid6_async_bench, bool, 0444);
+MODULE_PARM_DESC(async_bench, "Benchmark algorithms in the background after init");
+module_param_named(gen_mbps, raid6_gen_mbps, ulong, 0444);
+MODULE_PARM_DESC(gen_mbps, "Benchmarked gen_syndrome() throughput in MB/s");
+module_param_named(xor_mbps, raid6_xor_mbps, ulong, 0444);
+MODULE_PARM_DESC(xor_mbps, "Benchmarked xor_syndrome() throughput in MB/s");
+#endif
+
 const struct raid6_calls * const raid6_algos[] = {
 #if defined(__i386__) && !defined(__arch_um__)
 #ifdef CONFIG_AS_AVX512
@@ -145,11 +188,85 @@ static inline const struct raid6_recov_calls *raid6_choose_recov(void)
 	return best;
 }
 
-static inline const struct raid6_calls *raid6_choose_gen(
-	void *(*const dptrs)[(65536/PAGE_SIZE)+2], const int disks)
+static const struct raid6_calls *raid6_find_gen(const char *name)
+{
+	const struct raid6_calls *const *algo;
+
+	for (algo = raid6_algos; *algo; algo++) {
+		if (strcmp((*algo)->name, name))
+			continue;
+
+		if ((*algo)->valid && !(*algo)->valid()) {
+			pr_warn("raid6: algorithm %s not usable on this CPU\n",
+				name);
+			return NULL;
+		}
+		return *algo;
+	}
+
+	pr_warn("raid6: unknown algorithm %s\n", name);
+	return NULL;
+}
+
+/*
+ * Returns how many times the routine ran in 1<<RAID6_TIME_JIFFIES_LG2
+ * jiffies. At boot that is measured by spinning with preemption disabled.
+ * The deferred benchmark runs while the system is up, so it only keeps
+ * preemption off around each call, adds up the time spent in the calls
+ * and reschedules in between.
+ */
+static unsigned long raid6_bench_calls(const struct raid6_calls *algo,
+				       void **dptrs, const int disks,
+				       bool xor, bool async)
 {
-	unsigned long perf, bestgenperf, bestxorperf, j0, j1;
 	int start = (disks>>1)-1, stop = disks-3;	/* work on the second half of the disks */
+	unsigned long perf = 0, j0, j1;
+
+#ifdef __KERNEL__
+	if (async) {
+		u64 window = jiffies_to_nsecs(1<<RAID6_TIME_JIFFIES_LG2);
+		u64 t, busy = 0;
+
+		while (busy < window) {
+			preempt_disable();
+			t = ktime_get_ns();
+			if (xor)
+				algo->xor_syndrome(disks, start, stop,
+						   PAGE_SIZE, dptrs);
+			else
+				algo->gen_syndrome(disks, PAGE_SIZE, dptrs);
+			busy += ktime_get_ns() - t;
+			preempt_enable();
+			perf++;
+			cond_resched();
+		}
+
+		return div64_u64((u64)perf * window, busy);
+	}
+#endif
+
+	preempt_disable();
+	j0 = jiffies;
+	while ((j1 = jiffies) == j0)
+		cpu_relax();
+	while (time_before(jiffies, j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+		if (xor)
+			algo->xor_syndrome(disks, start, stop, PAGE_SIZE,
+					   dptrs);
+		else
+			algo->gen_syndrome(disks, PAGE_SIZE, dptrs);
+		perf++;
+	}
+	preempt_enable();
+
+	return perf;
+}
+
+static const struct raid6_calls *raid6_choose_gen(
+	void *(*const dptrs)[(65536/PAGE_SIZE)+2], const int disks,
+	bool bench, bool async, bool need_xor)
+{
+	unsigned long perf, bestgenperf, bestxorperf;
 	const struct raid6_calls *const *algo;
 	const struct raid6_calls *best;
 
@@ -158,23 +275,16 @@ static inline const struct raid6_calls *raid6_choose_gen(
 			if ((*algo)->valid && !(*algo)->valid())
 				continue;
 
-			if (!IS_ENABLED(CONFIG_RAID6_PQ_BENCHMARK)) {
+			if (need_xor && !(*algo)->xor_syndrome)
+				continue;
+
+			if (!bench) {
 				best = *algo;
 				break;
 			}
 
-			perf = 0;
-
-			preempt_disable();
-			j0 = jiffies;
-			while ((j1 = jiffies) == j0)
-				cpu_relax();
-			while (time_before(jiffies,
-					    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
-				(*algo)->gen_syndrome(disks, PAGE_SIZE, *dptrs);
-				perf++;
-			}
-			preempt_enable();
+			perf = raid6_bench_calls(*algo, *dptrs, disks, false,
+						 async);
 
 			if (perf > bestgenperf) {
 				bestgenperf = perf;
@@ -186,19 +296,8 @@ static inline const struct raid6_calls *raid6_choose_gen(
 			if (!(*algo)->xor_syndrome)
 				continue;
 
-			perf = 0;
-
-			preempt_disable();
-			j0 = jiffies;
-			while ((j1 = jiffies) == j0)
-				cpu_relax();
-			while (time_before(jiffies,
-					    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
-				(*algo)->xor_syndrome(disks, start, stop,
-						      PAGE_SIZE, *dptrs);
-				perf++;
-			}
-			preempt_enable();
+			perf = raid6_bench_calls(*algo, *dptrs, disks, true,
+						 async);
 
 			if (best == *algo)
 				bestxorperf = perf;
@@ -209,13 +308,15 @@ static inline const struct raid6_calls *raid6_choose_gen(
 	}
 
 	if (best) {
+		raid6_gen_mbps = (bestgenperf*HZ) >>
+				 (20-16+RAID6_TIME_JIFFIES_LG2);
+		raid6_xor_mbps = (bestxorperf*HZ) >>
+				 (20-16+RAID6_TIME_JIFFIES_LG2+1);
 		pr_info("raid6: using algorithm %s gen() %ld MB/s\n",
-		       best->name,
-		       (bestgenperf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2));
+		       best->name, raid6_gen_mbps);
 		if (best->xor_syndrome)
 			pr_info("raid6: .... xor() %ld MB/s, rmw enabled\n",
-			       (bestxorperf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2+1));
-		raid6_call = *best;
+			       raid6_xor_mbps);
 	} else
 		pr_err("raid6: Yikes!  No algorithm found!\n");
 
@@ -226,14 +327,9 @@ static inline const struct raid6_calls *raid6_choose_gen(
 /* Try to pick the best algorithm */
 /* This code uses the gfmul table as convenient data set to abuse */
 
-int __init raid6_select_algo(void)
+static char *raid6_alloc_dptrs(void **dptrs, const int disks)
 {
-	const int disks = (65536/PAGE_SIZE)+2;
-
-	const struct raid6_calls *gen_best;
-	const struct raid6_recov_calls *rec_best;
 	char *syndromes;
-	void *dptrs[(65536/PAGE_SIZE)+2];
 	int i;
 
 	for (i = 0; i < disks-2; i++)
@@ -244,26 +340,99 @@ int __init raid6_select_algo(void)
 
 	if (!syndromes) {
 		pr_err("raid6: Yikes!  No memory available.\n");
-		return -ENOMEM;
+		return NULL;
 	}
 
 	dptrs[disks-2] = syndromes;
 	dptrs[disks-1] = syndromes + PAGE_SIZE;
 
-	/* select raid gen_syndrome function */
-	gen_best = raid6_choose_gen(&dptrs, disks);
+	return syndromes;
+}
 
-	/* select raid recover functions */
-	rec_best = raid6_choose_recov();
+#ifdef __KERNEL__
+/*
+ * Runs the benchmark that raid6_select_algo() skipped and switches to the
+ * winner. Callers may be using raid6_call meanwhile; every routine set
+ * computes the same syndromes, so the pointers are replaced one at a time,
+ * and a set without xor_syndrome() is not picked once rmw may be in use.
+ */
+static void raid6_bench_work_fn(struct work_struct *work)
+{
+	const int disks = (65536/PAGE_SIZE)+2;
+
+	const struct raid6_calls *best;
+	char *syndromes;
+	void *dptrs[(65536/PAGE_SIZE)+2];
+
+	syndromes = raid6_alloc_dptrs(dptrs, disks);
+	if (!syndromes)
+		return;
+
+	best = raid6_choose_gen(&dptrs, disks, true, true,
+				raid6_call.xor_syndrome != NULL);
+	if (best && best->gen_syndrome != raid6_call.gen_syndrome) {
+		WRITE_ONCE(raid6_call.gen_syndrome, best->gen_syndrome);
+		WRITE_ONCE(raid6_call.xor_syndrome, best->xor_syndrome);
+		WRITE_ONCE(raid6_call.name, best->name);
+		raid6_call.prefer = best->prefer;
+	}
 
 	free_pages((unsigned long)syndromes, 1);
+}
+
+static DECLARE_WORK(raid6_bench_work, raid6_bench_work_fn);
+#endif
+
+int __init raid6_select_algo(void)
+{
+	const int disks = (65536/PAGE_SIZE)+2;
+
+	const struct raid6_calls *gen_best = NULL;
+	const struct raid6_recov_calls *rec_best;
+	char *syndromes;
+	void *dptrs[(65536/PAGE_SIZE)+2];
+	bool bench = IS_ENABLED(CONFIG_RAID6_PQ_BENCHMARK);
+
+	if (raid6_algo_name[0]) {
+		gen_best = raid6_find_gen(raid6_algo_name);
+		if (gen_best)
+			pr_info("raid6: using algorithm %s\n", gen_best->name);
+	}
+
+	if (!gen_best) {
+		syndromes = raid6_alloc_dptrs(dptrs, disks);
+		if (!syndromes)
+			return -ENOMEM;
+
+		/* select raid gen_syndrome function */
+		gen_best = raid6_choose_gen(&dptrs, disks,
+					    bench && !raid6_async_bench, false,
+					    false);
+
+		free_pages((unsigned long)syndromes, 1);
+	} else {
+		bench = false;
+	}
+
+	if (gen_best) {
+		raid6_call = *gen_best;
+#ifdef __KERNEL__
+		if (bench && raid6_async_bench)
+			queue_work(system_unbound_wq, &raid6_bench_work);
+#endif
+	}
+
+	/* select raid recover functions */
+	rec_best = raid6_choose_recov();
 
 	return gen_best && rec_best ? 0 : -EINVAL;
 }
 
 static void raid6_exit(void)
 {
-	do { } while (0);
+#ifdef __KERNEL__
+	cancel_work_sync(&raid6_bench_work);
+#endif
 }
 
 subsys_initcall(raid6_select_algo);
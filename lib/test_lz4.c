@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test module for LZ4 decompression: checks that every decoder entry point
+ * reproduces its input exactly and reports decompression throughput, both
+ * for whole buffers and page by page the way zram uses it.
+ *
+ * Synthetic corpora are always run. Real data can be added with
+ *	modprobe test_lz4 corpus=/path/to/file
+ * in which case up to the first 4MB of the file are used.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#define CORPUS_SIZE	SZ_1M
+#define CORPUS_MAX	SZ_4M
+
+static char *corpus;
+module_param(corpus, charp, 0444);
+MODULE_PARM_DESC(corpus, "Path of an extra file to test and benchmark");
+
+static unsigned int rounds = 32;
+module_param(rounds, uint, 0444);
+MODULE_PARM_DESC(rounds, "Number of decompression passes per benchmark");
+
+static void *wrkmem, *cbuf, *dbuf;
+
+static const char * const words[] = {
+	"the", "kernel", "page", "memory", "struct", "return", "null",
+	"android", "java", "lang", "object", "string", "0x0000", "int",
+	"void", "static", "const", "for", "if", "else", "class", "field",
+};
+
+/* English-like text with short and medium distance repeats */
+static void fill_text(u8 *buf, size_t len, struct rnd_state *rnd)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		const char *w = words[prandom_u32_state(rnd) % ARRAY_SIZE(words)];
+		size_t n = min(strlen(w), len - i);
+
+		memcpy(buf + i, w, n);
+		i += n;
+		if (i < len)
+			buf[i++] = (prandom_u32_state(rnd) & 7) ? ' ' : '\n';
+	}
+}
+
+/* runs with every period from 1 to 31, the overlapping match copies */
+static void fill_periodic(u8 *buf, size_t len, struct rnd_state *rnd)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		size_t period = 1 + prandom_u32_state(rnd) % 31;
+		size_t run = min_t(size_t, 64 + prandom_u32_state(rnd) % 4096,
+				   len - i);
+		size_t j;
+
+		prandom_bytes_state(rnd, buf + i, min(period, run));
+		for (j = period; j < run; j++)
+			buf[i + j] = buf[i + j - period];
+		i += run;
+	}
+}
+
+/* mostly zero pages with a few words set, like a sparse heap */
+static void fill_sparse(u8 *buf, size_t len, struct rnd_state *rnd)
+{
+	size_t i;
+
+	memset(buf, 0, len);
+	for (i = 0; i < len / 64; i++)
+		buf[prandom_u32_state(rnd) % len] = prandom_u32_state(rnd);
+}
+
+/* alternating literal-heavy and compressible blocks */
+static void fill_mixed(u8 *buf, size_t len, struct rnd_state *rnd)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += 512) {
+		size_t n = min_t(size_t, 512, len - i);
+
+		if ((i / 512) & 1)
+			prandom_bytes_state(rnd, buf + i, n);
+		else
+			fill_text(buf + i, n, rnd);
+	}
+}
+
+static void fill_random(u8 *buf, size_t len, struct rnd_state *rnd)
+{
+	prandom_bytes_state(rnd, buf, len);
+}
+
+static const struct {
+	const char *name;
+	void (*fill)(u8 *buf, size_t len, struct rnd_state *rnd);
+} corpora[] = {
+	{ "text",	fill_text },
+	{ "periodic",	fill_periodic },
+	{ "sparse",	fill_sparse },
+	{ "mixed",	fill_mixed },
+	{ "random",	fill_random },
+};
+
+static u64 mb_per_sec(u64 bytes, u64 ns)
+{
+	return ns ? div64_u64(bytes * NSEC_PER_SEC, ns * SZ_1M) : 0;
+}
+
+static int test_buffer(const char *name, const u8 *src, size_t len)
+{
+	size_t csize_total = 0, off;
+	int csize, ret, i;
+	u64 start, whole_ns, page_ns;
+
+	csize = LZ4_compress_default(src, cbuf, len, LZ4_compressBound(len),
+				     wrkmem);
+	if (csize <= 0) {
+		pr_err("%s: compression failed\n", name);
+		return -EINVAL;
+	}
+
+	memset(dbuf, 0xa5, len);
+	ret = LZ4_decompress_safe(cbuf, dbuf, csize, len);
+	if (ret != len || memcmp(src, dbuf, len)) {
+		pr_err("%s: LZ4_decompress_safe mismatch (%d)\n", name, ret);
+		return -EINVAL;
+	}
+
+	memset(dbuf, 0xa5, len);
+	ret = LZ4_decompress_fast(cbuf, dbuf, len);
+	if (ret != csize || memcmp(src, dbuf, len)) {
+		pr_err("%s: LZ4_decompress_fast mismatch (%d)\n", name, ret);
+		return -EINVAL;
+	}
+
+	memset(dbuf, 0xa5, len);
+	ret = LZ4_decompress_safe_partial(cbuf, dbuf, csize, len / 3, len);
+	if (ret < 0 || (size_t)ret < len / 3 || memcmp(src, dbuf, len / 3)) {
+		pr_err("%s: LZ4_decompress_safe_partial mismatch (%d)\n",
+		       name, ret);
+		return -EINVAL;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < rounds; i++) {
+		LZ4_decompress_safe(cbuf, dbuf, csize, len);
+		cond_resched();
+	}
+	whole_ns = ktime_get_ns() - start;
+
+	/* page sized blocks, as zram stores them */
+	page_ns = 0;
+	for (off = 0; off + PAGE_SIZE <= len; off += PAGE_SIZE) {
+		csize = LZ4_compress_default(src + off, cbuf, PAGE_SIZE,
+					     LZ4_compressBound(PAGE_SIZE),
+					     wrkmem);
+		if (csize <= 0) {
+			pr_err("%s: page compression failed\n", name);
+			return -EINVAL;
+		}
+		csize_total += csize;
+
+		ret = LZ4_decompress_safe(cbuf, dbuf, csize, PAGE_SIZE);
+		if (ret != PAGE_SIZE || memcmp(src + off, dbuf, PAGE_SIZE)) {
+			pr_err("%s: page at %zu mismatch (%d)\n",
+			       name, off, ret);
+			return -EINVAL;
+		}
+
+		start = ktime_get_ns();
+		for (i = 0; i < rounds; i++)
+			LZ4_decompress_safe(cbuf, dbuf, csize, PAGE_SIZE);
+		page_ns += ktime_get_ns() - start;
+		cond_resched();
+	}
+
+	pr_info("%-10s %8zu -> %8zu bytes per page, whole %5llu MB/s, paged %5llu MB/s\n",
+		name, len, csize_total,
+		mb_per_sec((u64)len * rounds, whole_ns),
+		mb_per_sec((u64)rounds * round_down(len, PAGE_SIZE), page_ns));
+	return 0;
+}
+
+static int test_corpus_file(const char *path)
+{
+	void *data = NULL;
+	loff_t size = 0;
+	int ret;
+
+	ret = kernel_read_file_from_path(path, &data, &size, CORPUS_MAX,
+					 READING_UNKNOWN);
+	if (ret == -EFBIG) {
+		pr_err("%s is larger than %d bytes\n", path, CORPUS_MAX);
+		return ret;
+	}
+	if (ret) {
+		pr_err("cannot read %s: %d\n", path, ret);
+		return ret;
+	}
+
+	ret = size ? test_buffer(kbasename(path), data, size) : -EINVAL;
+	vfree(data);
+	return ret;
+}
+
+static int __init test_lz4_init(void)
+{
+	struct rnd_state rnd;
+	size_t max = corpus ? CORPUS_MAX : CORPUS_SIZE;
+	u8 *src;
+	int i, ret = -ENOMEM;
+
+	wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+	cbuf = vmalloc(LZ4_compressBound(max));
+	dbuf = vmalloc(max);
+	src = vmalloc(CORPUS_SIZE);
+	if (!wrkmem || !cbuf || !dbuf || !src)
+		goto out;
+
+	prandom_seed_state(&rnd, 3141592653589793238ULL);
+	for (i = 0; i < ARRAY_SIZE(corpora); i++) {
+		corpora[i].fill(src, CORPUS_SIZE, &rnd);
+		ret = test_buffer(corpora[i].name, src, CORPUS_SIZE);
+		if (ret)
+			goto out;
+	}
+
+	if (corpus)
+		ret = test_corpus_file(corpus);
+out:
+	vfree(src);
+	vfree(dbuf);
+	vfree(cbuf);
+	vfree(wrkmem);
+	if (!ret)
+		pr_info("all tests passed\n");
+	/* nothing to keep loaded */
+	return ret ? ret : -EAGAIN;
+}
+
+module_init(test_lz4_init);
+MODULE_DESCRIPTION("LZ4 decompression test and benchmark");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,278 @@
+/*
+ * Multithreaded single-call .xz decoder
+ *
+ * Every Block of a .xz Stream starts with a fresh LZMA2 dictionary and
+ * filter state, so when the whole Stream is in memory the Blocks can be
+ * decoded independently of each other. The Index at the end of the Stream
+ * gives the compressed and uncompressed size of every Block, which is all
+ * that is needed to know where each Block starts in the input and where
+ * its output goes.
+ *
+ * This file has been put into the public domain.
+ * You can do whatever you want with this file.
+ */
+
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/workqueue.h>
+#include "xz_private.h"
+#include "xz_stream.h"
+
+/* Location of one Block in the input and output buffers */
+struct xz_mt_block {
+	size_t in_pos;
+	size_t in_size;
+	size_t out_pos;
+	size_t out_size;
+};
+
+struct xz_mt {
+	const uint8_t *in;
+	uint8_t *out;
+	struct xz_mt_block *blocks;
+	unsigned int count;
+	enum xz_check check_type;
+
+	/* Index of the next Block to decode */
+	atomic_t next;
+
+	/* XZ_STREAM_END, or the first error seen by any thread */
+	atomic_t ret;
+};
+
+struct xz_mt_worker {
+	struct work_struct work;
+	struct xz_mt *mt;
+	struct xz_dec *s;
+};
+
+static bool mt_vli(const uint8_t *in, size_t *pos, size_t end, vli_type *vli)
+{
+	uint32_t i;
+	uint8_t byte;
+
+	*vli = 0;
+	for (i = 0; i < VLI_BYTES_MAX && *pos < end; ++i) {
+		byte = in[(*pos)++];
+		*vli |= (vli_type)(byte & 0x7F) << (i * 7);
+
+		if (!(byte & 0x80))
+			/* Don't allow non-minimal encodings. */
+			return byte != 0 || i == 0;
+	}
+
+	return false;
+}
+
+/*
+ * Parse the Stream Header, Stream Footer and Index, and fill mt->blocks.
+ * Returns XZ_OK if the Stream can be decoded in parallel, XZ_STREAM_END if
+ * it should rather be decoded sequentially (including when it is corrupt,
+ * so that the error is reported exactly like xz_dec_run() would), or
+ * XZ_MEM_ERROR.
+ */
+static enum xz_ret mt_parse(struct xz_mt *mt, const struct xz_buf *b)
+{
+	const uint8_t *in = b->in + b->in_pos;
+	size_t size = b->in_size - b->in_pos;
+	size_t footer, index, pos, end, in_pos, out_pos;
+	vli_type count, unpadded, padded, uncompressed;
+	unsigned int i;
+
+	if (size < 2 * STREAM_HEADER_SIZE + 8)
+		return XZ_STREAM_END;
+
+	if (!memeq(in, HEADER_MAGIC, HEADER_MAGIC_SIZE)
+			|| xz_crc32(in + HEADER_MAGIC_SIZE, 2, 0)
+				!= get_le32(in + HEADER_MAGIC_SIZE + 2)
+			|| in[HEADER_MAGIC_SIZE] != 0)
+		return XZ_STREAM_END;
+
+	mt->check_type = in[HEADER_MAGIC_SIZE + 1];
+	if (mt->check_type != XZ_CHECK_NONE
+			&& mt->check_type != XZ_CHECK_CRC32)
+		return XZ_STREAM_END;
+
+	footer = size - STREAM_HEADER_SIZE;
+	if (!memeq(in + footer + 10, FOOTER_MAGIC, FOOTER_MAGIC_SIZE)
+			|| xz_crc32(in + footer + 4, 6, 0)
+				!= get_le32(in + footer)
+			|| !memeq(in + footer + 8, in + HEADER_MAGIC_SIZE, 2))
+		return XZ_STREAM_END;
+
+	/* Backward Size */
+	end = ((size_t)get_le32(in + footer + 4) + 1) * 4;
+	if (end > footer - STREAM_HEADER_SIZE)
+		return XZ_STREAM_END;
+
+	index = footer - end;
+	if (in[index] != 0 || xz_crc32(in + index, end - 4, 0)
+			!= get_le32(in + footer - 4))
+		return XZ_STREAM_END;
+
+	pos = index + 1;
+	end = footer - 4;
+	if (!mt_vli(in, &pos, end, &count) || count < 2
+			|| count > (end - pos) / 2)
+		return XZ_STREAM_END;
+
+	mt->count = count;
+	mt->blocks = kmalloc_array(mt->count, sizeof(*mt->blocks),
+				   GFP_KERNEL);
+	if (mt->blocks == NULL)
+		return XZ_MEM_ERROR;
+
+	in_pos = STREAM_HEADER_SIZE;
+	out_pos = b->out_pos;
+	for (i = 0; i < mt->count; ++i) {
+		if (!mt_vli(in, &pos, end, &unpadded)
+				|| !mt_vli(in, &pos, end, &uncompressed))
+			goto sequential;
+
+		padded = (unpadded + 3) & ~(vli_type)3;
+		if (unpadded == 0 || padded > index - in_pos
+				|| uncompressed > b->out_size - out_pos)
+			goto sequential;
+
+		mt->blocks[i].in_pos = b->in_pos + in_pos;
+		mt->blocks[i].in_size = padded;
+		mt->blocks[i].out_pos = out_pos;
+		mt->blocks[i].out_size = uncompressed;
+
+		in_pos += mt->blocks[i].in_size;
+		out_pos += uncompressed;
+	}
+
+	/* Index Padding must be zeros and the Blocks must fill the gap. */
+	while (pos < end)
+		if (in[pos++] != 0)
+			goto sequential;
+
+	if (in_pos != index)
+		goto sequential;
+
+	mt->in = b->in;
+	mt->out = b->out;
+	return XZ_OK;
+
+sequential:
+	kfree(mt->blocks);
+	mt->blocks = NULL;
+	return XZ_STREAM_END;
+}
+
+static void mt_decode(struct xz_mt *mt, struct xz_dec *s)
+{
+	const struct xz_mt_block *block;
+	struct xz_buf b;
+	enum xz_ret ret;
+	unsigned int i;
+
+	while (atomic_read(&mt->ret) == XZ_STREAM_END) {
+		i = atomic_inc_return(&mt->next) - 1;
+		if (i >= mt->count)
+			break;
+
+		block = &mt->blocks[i];
+		b.in = mt->in + block->in_pos;
+		b.in_pos = 0;
+		b.in_size = block->in_size;
+		b.out = mt->out + block->out_pos;
+		b.out_pos = 0;
+		b.out_size = block->out_size;
+
+		/*
+		 * The output slice is sized from the Index, so running out
+		 * of it means the Index and the Block disagree.
+		 */
+		ret = xz_dec_block_run(s, &b, mt->check_type);
+		if (ret == XZ_BUF_ERROR || (ret == XZ_STREAM_END
+				&& (b.in_pos != b.in_size
+					|| b.out_pos != b.out_size)))
+			ret = XZ_DATA_ERROR;
+
+		if (ret != XZ_STREAM_END)
+			atomic_cmpxchg(&mt->ret, XZ_STREAM_END, ret);
+	}
+}
+
+static void mt_work(struct work_struct *work)
+{
+	struct xz_mt_worker *w = container_of(work, struct xz_mt_worker, work);
+
+	mt_decode(w->mt, w->s);
+}
+
+static enum xz_ret mt_sequential(struct xz_buf *b)
+{
+	struct xz_dec *s;
+	enum xz_ret ret;
+
+	s = xz_dec_init(XZ_SINGLE, 0);
+	if (s == NULL)
+		return XZ_MEM_ERROR;
+
+	ret = xz_dec_run(s, b);
+	xz_dec_end(s);
+	return ret;
+}
+
+XZ_EXTERN enum xz_ret xz_dec_mt_run(struct xz_buf *b, unsigned int max_threads)
+{
+	struct xz_mt mt = { .blocks = NULL };
+	struct xz_mt_worker *workers;
+	struct xz_dec *s;
+	unsigned int i, n;
+	enum xz_ret ret;
+
+	ret = mt_parse(&mt, b);
+	if (ret == XZ_STREAM_END)
+		return mt_sequential(b);
+	if (ret != XZ_OK)
+		return ret;
+
+	if (max_threads == 0)
+		max_threads = num_online_cpus();
+	n = min(max_threads, mt.count) - 1;
+
+	ret = XZ_MEM_ERROR;
+	s = xz_dec_init(XZ_SINGLE, 0);
+	workers = kcalloc(n, sizeof(*workers), GFP_KERNEL);
+	if (s == NULL || (n > 0 && workers == NULL))
+		goto out;
+
+	atomic_set(&mt.next, 0);
+	atomic_set(&mt.ret, XZ_STREAM_END);
+
+	/* Fewer helpers is fine if some decoder states can't be allocated. */
+	for (i = 0; i < n; ++i) {
+		workers[i].s = xz_dec_init(XZ_SINGLE, 0);
+		if (workers[i].s == NULL)
+			break;
+
+		workers[i].mt = &mt;
+		INIT_WORK(&workers[i].work, mt_work);
+		queue_work(system_unbound_wq, &workers[i].work);
+	}
+	n = i;
+
+	mt_decode(&mt, s);
+
+	for (i = 0; i < n; ++i) {
+		flush_work(&workers[i].work);
+		xz_dec_end(workers[i].s);
+	}
+
+	ret = atomic_read(&mt.ret);
+	if (ret == XZ_STREAM_END) {
+		b->in_pos = b->in_size;
+		b->out_pos = mt.blocks[mt.count - 1].out_pos
+				+ mt.blocks[mt.count - 1].out_size;
+	}
+
+out:
+	kfree(workers);
+	xz_dec_end(s);
+	kfree(mt.blocks);
+	return ret;
+}
@@ -14,6 +14,9 @@ EXPORT_SYMBOL(xz_dec_init);
 EXPORT_SYMBOL(xz_dec_reset);
 EXPORT_SYMBOL(xz_dec_run);
 EXPORT_SYMBOL(xz_dec_end);
+#ifdef CONFIG_XZ_DEC_MT
+EXPORT_SYMBOL(xz_dec_mt_run);
+#endif
 
 MODULE_DESCRIPTION("XZ decompressor");
 MODULE_VERSION("1.0");
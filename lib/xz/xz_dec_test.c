@@ -12,6 +12,7 @@
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 #include <linux/crc32.h>
+#include <linux/vmalloc.h>
 #include <linux/xz.h>
 
 /* Maximum supported dictionary size */
@@ -61,6 +62,96 @@ static struct xz_buf buffers = {
  */
 static uint32_t crc;
 
+#ifdef CONFIG_XZ_DEC_MT
+/*
+ * Copy of the input for decoding it once more with xz_dec_mt_run() when the
+ * Stream ends. Its CRC32 is printed next to the one above, so the parallel
+ * decoder can be checked with files made with "xz --block-size" or "xz -T".
+ * Input larger than MT_IN_MAX is only decoded sequentially.
+ */
+#define MT_IN_MAX (8 << 20)
+
+static uint8_t *mt_in;
+static size_t mt_in_size;
+static size_t mt_out_size;
+
+/* Without the copy, only the sequential decoder is tested. */
+static void xz_dec_test_mt_init(void)
+{
+	mt_in = vmalloc(MT_IN_MAX);
+}
+
+static void xz_dec_test_mt_exit(void)
+{
+	vfree(mt_in);
+}
+
+static void xz_dec_test_mt_reset(void)
+{
+	mt_in_size = 0;
+	mt_out_size = 0;
+}
+
+/* Called with the input just copied to buffer_in and the output just decoded */
+static void xz_dec_test_mt_save(size_t in_size, size_t out_size)
+{
+	mt_out_size += out_size;
+
+	if (mt_in == NULL || mt_in_size + in_size > MT_IN_MAX) {
+		mt_in_size = MT_IN_MAX + 1;
+		return;
+	}
+
+	memcpy(mt_in + mt_in_size, buffer_in, in_size);
+	mt_in_size += in_size;
+}
+
+/* @unused is how much of the last input chunk is after the end of the Stream */
+static void xz_dec_test_mt_run(size_t unused)
+{
+	struct xz_buf b = {
+		.in = mt_in,
+		.in_size = mt_in_size - unused,
+		.out_size = mt_out_size
+	};
+	enum xz_ret mt_ret;
+	uint8_t *out;
+
+	if (mt_in_size > MT_IN_MAX) {
+		printk(KERN_INFO DEVICE_NAME ": input not kept for "
+				"xz_dec_mt_run()\n");
+		return;
+	}
+
+	out = vmalloc(max_t(size_t, mt_out_size, 1));
+	if (out == NULL) {
+		printk(KERN_INFO DEVICE_NAME ": no memory for "
+				"xz_dec_mt_run()\n");
+		return;
+	}
+
+	b.out = out;
+	mt_ret = xz_dec_mt_run(&b, 0);
+	if (mt_ret == XZ_STREAM_END && b.in_pos == b.in_size
+			&& b.out_pos == mt_out_size)
+		printk(KERN_INFO DEVICE_NAME ": xz_dec_mt_run() "
+				"XZ_STREAM_END, CRC32 = 0x%08X\n",
+				~crc32(0xFFFFFFFF, out, b.out_pos));
+	else
+		printk(KERN_INFO DEVICE_NAME ": xz_dec_mt_run() failed: "
+				"ret %d, in %zu/%zu, out %zu/%zu\n", mt_ret,
+				b.in_pos, b.in_size, b.out_pos, mt_out_size);
+
+	vfree(out);
+}
+#else
+static inline void xz_dec_test_mt_init(void) { }
+static inline void xz_dec_test_mt_exit(void) { }
+static inline void xz_dec_test_mt_reset(void) { }
+static inline void xz_dec_test_mt_save(size_t in_size, size_t out_size) { }
+static inline void xz_dec_test_mt_run(size_t unused) { }
+#endif
+
 static int xz_dec_test_open(struct inode *i, struct file *f)
 {
 	if (device_is_open)
@@ -76,6 +167,8 @@ static int xz_dec_test_open(struct inode *i, struct file *f)
 	buffers.in_size = 0;
 	buffers.out_pos = 0;
 
+	xz_dec_test_mt_reset();
+
 	printk(KERN_INFO DEVICE_NAME ": opened\n");
 	return 0;
 }
@@ -103,6 +196,7 @@ static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 				 size_t size, loff_t *pos)
 {
 	size_t remaining;
+	size_t new_in = 0;
 
 	if (ret != XZ_OK) {
 		if (size > 0)
@@ -125,6 +219,7 @@ static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 			if (copy_from_user(buffer_in, buf, buffers.in_size))
 				return -EFAULT;
 
+			new_in = buffers.in_size;
 			buf += buffers.in_size;
 			remaining -= buffers.in_size;
 		}
@@ -132,6 +227,8 @@ static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 		buffers.out_pos = 0;
 		ret = xz_dec_run(state, &buffers);
 		crc = crc32(crc, buffer_out, buffers.out_pos);
+		xz_dec_test_mt_save(new_in, buffers.out_pos);
+		new_in = 0;
 	}
 
 	switch (ret) {
@@ -142,6 +239,7 @@ static ssize_t xz_dec_test_write(struct file *file, const char __user *buf,
 	case XZ_STREAM_END:
 		printk(KERN_INFO DEVICE_NAME ": XZ_STREAM_END, "
 				"CRC32 = 0x%08X\n", ~crc);
+		xz_dec_test_mt_run(buffers.in_size - buffers.in_pos);
 		return size - remaining - (buffers.in_size - buffers.in_pos);
 
 	case XZ_MEMLIMIT_ERROR:
@@ -186,8 +284,11 @@ static int __init xz_dec_test_init(void)
 	if (state == NULL)
 		return -ENOMEM;
 
+	xz_dec_test_mt_init();
+
 	device_major = register_chrdev(0, DEVICE_NAME, &fileops);
 	if (device_major < 0) {
+		xz_dec_test_mt_exit();
 		xz_dec_end(state);
 		return device_major;
 	}
@@ -202,6 +303,7 @@ static int __init xz_dec_test_init(void)
 static void __exit xz_dec_test_exit(void)
 {
 	unregister_chrdev(device_major, DEVICE_NAME);
+	xz_dec_test_mt_exit();
 	xz_dec_end(state);
 	printk(KERN_INFO DEVICE_NAME ": module unloaded\n");
 }
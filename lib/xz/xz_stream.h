@@ -59,4 +59,13 @@ enum xz_check {
 /* Maximum possible Check ID */
 #define XZ_CHECK_MAX 15
 
+#ifdef XZ_DEC_MT
+/*
+ * Decode one Block of a Stream whose Check ID is check_type, in single-call
+ * mode. Used by xz_dec_mt_run() to decode Blocks independently.
+ */
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, struct xz_buf *b,
+				       enum xz_check check_type);
+#endif
+
 #endif
@@ -4,6 +4,7 @@
  */
 
 #include <linux/zutil.h>
+#include <asm/unaligned.h>
 #include "inftrees.h"
 #include "inflate.h"
 #include "inffast.h"
@@ -27,6 +28,21 @@ get_unaligned16(const unsigned short *p)
 	return mm.us;
 }
 
+#ifdef INFLATE_FAST_WIDE
+/*
+ * Top the bit accumulator up to at least 56 bits with a single unaligned
+ * load. That is enough for a whole length/distance pair (48 bits), so the
+ * byte-wise refills further down never trigger. The bits above "bits" in
+ * hold are the following input bits, not zeroes, but every user masks them
+ * off and the next refill ORs in the same values again.
+ */
+#define REFILL() do { \
+	hold |= (unsigned long)get_unaligned_le64(in) << bits; \
+	in += (63 - bits) >> 3; \
+	bits |= 56; \
+} while (0)
+#endif
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -38,8 +54,8 @@ get_unaligned16(const unsigned short *p)
    Entry assumptions:
 
         state->mode == LEN
-        strm->avail_in >= 6
-        strm->avail_out >= 258
+        strm->avail_in >= INFLATE_FAST_MIN_IN
+        strm->avail_out >= INFLATE_FAST_MIN_OUT
         start >= strm->avail_out
         state->bits < 8
 
@@ -55,7 +71,8 @@ get_unaligned16(const unsigned short *p)
       length code, 5 bits for the length extra, 15 bits for the distance code,
       and 13 bits for the distance extra.  This totals 48 bits, or six bytes.
       Therefore if strm->avail_in >= 6, then there is enough input to avoid
-      checking for available input while decoding.
+      checking for available input while decoding. The wide refill loads
+      eight bytes at once, so it needs strm->avail_in >= 8 instead.
 
     - The maximum bytes that a single length/distance pair can output is 258
       bytes, which is the maximum length that can be coded.  inflate_fast()
@@ -95,7 +112,7 @@ void inflate_fast(z_streamp strm, unsigned start)
     /* copy state to local variables */
     state = (struct inflate_state *)strm->state;
     in = strm->next_in;
-    last = in + (strm->avail_in - 5);
+    last = in + (strm->avail_in - (INFLATE_FAST_MIN_IN - 1));
     out = strm->next_out;
     beg = out - (start - strm->avail_out);
     end = out + (strm->avail_out - 257);
@@ -116,12 +133,16 @@ void inflate_fast(z_streamp strm, unsigned start)
     /* decode literals and length/distances until end-of-block or not enough
        input data or output space */
     do {
+#ifdef INFLATE_FAST_WIDE
+        REFILL();
+#else
         if (bits < 15) {
             hold += (unsigned long)(*in++) << bits;
             bits += 8;
             hold += (unsigned long)(*in++) << bits;
             bits += 8;
         }
+#endif
         this = lcode[hold & lmask];
       dolen:
         op = (unsigned)(this.bits);
@@ -130,6 +151,21 @@ void inflate_fast(z_streamp strm, unsigned start)
         op = (unsigned)(this.op);
         if (op == 0) {                          /* literal */
             *out++ = (unsigned char)(this.val);
+#ifdef INFLATE_FAST_WIDE
+            /* 41 bits are left, enough for two more literals */
+            this = lcode[hold & lmask];
+            if (this.op == 0) {
+                hold >>= this.bits;
+                bits -= this.bits;
+                *out++ = (unsigned char)(this.val);
+                this = lcode[hold & lmask];
+                if (this.op == 0) {
+                    hold >>= this.bits;
+                    bits -= this.bits;
+                    *out++ = (unsigned char)(this.val);
+                }
+            }
+#endif
         }
         else if (op & 16) {                     /* length base */
             len = (unsigned)(this.val);
@@ -189,9 +225,8 @@ void inflate_fast(z_streamp strm, unsigned start)
                         from += wsize - op;
                         if (op < len) {         /* some from window */
                             len -= op;
-                            do {
-                                *out++ = *from++;
-                            } while (--op);
+                            memcpy(out, from, op);
+                            out += op;
                             from = out - dist;  /* rest from output */
                         }
                     }
@@ -218,9 +253,8 @@ void inflate_fast(z_streamp strm, unsigned start)
                         from += write - op;
                         if (op < len) {         /* some from window */
                             len -= op;
-                            do {
-                                *out++ = *from++;
-                            } while (--op);
+                            memcpy(out, from, op);
+                            out += op;
                             from = out - dist;  /* rest from output */
                         }
                     }
@@ -236,6 +270,27 @@ void inflate_fast(z_streamp strm, unsigned start)
                             *out++ = *from++;
                     }
                 }
+#ifdef INFLATE_FAST_WIDE
+                else if (dist >= 8 &&
+                         len + 7 <= (unsigned)(end - out) + 257) {
+                    /*
+                     * Copy direct from output eight bytes at a time. The
+                     * source may overlap the destination, but never by less
+                     * than eight bytes, so every load sees finished output.
+                     * The last store can run up to seven bytes past the
+                     * match, which was checked to be within the buffer.
+                     */
+                    unsigned char *mend = out + len;
+
+                    from = out - dist;
+                    do {
+                        put_unaligned(get_unaligned((u64 *)from), (u64 *)out);
+                        out += 8;
+                        from += 8;
+                    } while (out < mend);
+                    out = mend;
+                }
+#endif
                 else {
 		    unsigned short *sout;
 		    unsigned long loops;
@@ -317,7 +372,9 @@ void inflate_fast(z_streamp strm, unsigned start)
     /* update state and return */
     strm->next_in = in;
     strm->next_out = out;
-    strm->avail_in = (unsigned)(in < last ? 5 + (last - in) : 5 - (in - last));
+    strm->avail_in = (unsigned)(in < last ?
+                                (INFLATE_FAST_MIN_IN - 1) + (last - in) :
+                                (INFLATE_FAST_MIN_IN - 1) - (in - last));
     strm->avail_out = (unsigned)(out < end ?
                                  257 + (end - out) : 257 - (out - end));
     state->hold = hold;
@@ -8,4 +8,17 @@
    subject to change. Applications should only use zlib.h.
  */
 
+/*
+ * On 64-bit machines with cheap unaligned loads inflate_fast() refills its
+ * bit accumulator eight bytes at a time, so it needs two more bytes of
+ * input to be available on entry than the byte-wise version.
+ */
+#if BITS_PER_LONG == 64 && defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+#define INFLATE_FAST_WIDE
+#define INFLATE_FAST_MIN_IN 8
+#else
+#define INFLATE_FAST_MIN_IN 6
+#endif
+#define INFLATE_FAST_MIN_OUT 258
+
 void inflate_fast (z_streamp strm, unsigned start);
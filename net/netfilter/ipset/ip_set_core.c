@@ -1526,6 +1526,49 @@ static const struct nla_policy ip_set_adt_policy[IPSET_ATTR_CMD_MAX + 1] = {
 	[IPSET_ATTR_ADT]	= { .type = NLA_NESTED },
 };
 
+/* Error in restore/batch mode: send back lineno */
+static int
+ip_set_report_lineno(struct sock *ctnl, struct sk_buff *skb, int ret,
+		     u32 lineno)
+{
+	struct nlmsghdr *rep, *nlh = nlmsg_hdr(skb);
+	struct sk_buff *skb2;
+	struct nlmsgerr *errmsg;
+	size_t payload = min(SIZE_MAX,
+			     sizeof(*errmsg) + nlmsg_len(nlh));
+	int min_len = nlmsg_total_size(sizeof(struct nfgenmsg));
+	struct nlattr *cda[IPSET_ATTR_CMD_MAX + 1];
+	struct nlattr *cmdattr;
+	u32 *errline;
+
+	skb2 = nlmsg_new(payload, GFP_KERNEL);
+	if (!skb2)
+		return -ENOMEM;
+	rep = __nlmsg_put(skb2, NETLINK_CB(skb).portid,
+			  nlh->nlmsg_seq, NLMSG_ERROR, payload, 0);
+	errmsg = nlmsg_data(rep);
+	errmsg->error = ret;
+	memcpy(&errmsg->msg, nlh, nlh->nlmsg_len);
+	cmdattr = (void *)&errmsg->msg + min_len;
+
+	ret = nla_parse(cda, IPSET_ATTR_CMD_MAX, cmdattr,
+			nlh->nlmsg_len - min_len, ip_set_adt_policy,
+			NULL);
+
+	if (ret) {
+		nlmsg_free(skb2);
+		return ret;
+	}
+	errline = nla_data(cda[IPSET_ATTR_LINENO]);
+
+	*errline = lineno;
+
+	netlink_unicast(ctnl, skb2, NETLINK_CB(skb).portid,
+			MSG_DONTWAIT);
+	/* Signal netlink not to send its ACK/errmsg.  */
+	return -EINTR;
+}
+
 static int
 call_ad(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
 	struct nlattr *tb[], enum ipset_adt adt,
@@ -1554,45 +1597,8 @@ call_ad(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
 
 	if (!ret || (ret == -IPSET_ERR_EXIST && eexist))
 		return 0;
-	if (lineno && use_lineno) {
-		/* Error in restore/batch mode: send back lineno */
-		struct nlmsghdr *rep, *nlh = nlmsg_hdr(skb);
-		struct sk_buff *skb2;
-		struct nlmsgerr *errmsg;
-		size_t payload = min(SIZE_MAX,
-				     sizeof(*errmsg) + nlmsg_len(nlh));
-		int min_len = nlmsg_total_size(sizeof(struct nfgenmsg));
-		struct nlattr *cda[IPSET_ATTR_CMD_MAX + 1];
-		struct nlattr *cmdattr;
-		u32 *errline;
-
-		skb2 = nlmsg_new(payload, GFP_KERNEL);
-		if (!skb2)
-			return -ENOMEM;
-		rep = __nlmsg_put(skb2, NETLINK_CB(skb).portid,
-				  nlh->nlmsg_seq, NLMSG_ERROR, payload, 0);
-		errmsg = nlmsg_data(rep);
-		errmsg->error = ret;
-		memcpy(&errmsg->msg, nlh, nlh->nlmsg_len);
-		cmdattr = (void *)&errmsg->msg + min_len;
-
-		ret = nla_parse(cda, IPSET_ATTR_CMD_MAX, cmdattr,
-				nlh->nlmsg_len - min_len, ip_set_adt_policy,
-				NULL);
-
-		if (ret) {
-			nlmsg_free(skb2);
-			return ret;
-		}
-		errline = nla_data(cda[IPSET_ATTR_LINENO]);
-
-		*errline = lineno;
-
-		netlink_unicast(ctnl, skb2, NETLINK_CB(skb).portid,
-				MSG_DONTWAIT);
-		/* Signal netlink not to send its ACK/errmsg.  */
-		return -EINTR;
-	}
+	if (lineno && use_lineno)
+		return ip_set_report_lineno(ctnl, skb, ret, lineno);
 
 	return ret;
 }
@@ -1638,6 +1644,15 @@ static int ip_set_ad(struct net *net, struct sock *ctnl,
 	} else {
 		int nla_rem;
 
+		if (adt == IPSET_ADD && set->variant->reserve) {
+			u32 nelems = 0;
+
+			nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem)
+				nelems++;
+			/* Best effort: the set still grows on demand below */
+			set->variant->reserve(set, nelems);
+		}
+
 		nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem) {
 			if (nla_type(nla) != IPSET_ATTR_DATA ||
 			    !flag_nested(nla) ||
@@ -1679,31 +1694,66 @@ static int ip_set_utest(struct net *net, struct sock *ctnl, struct sk_buff *skb,
 	struct ip_set_net *inst = ip_set_pernet(net);
 	struct ip_set *set;
 	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1] = {};
-	int ret = 0;
+	const struct nlattr *nla;
+	int nla_rem, ret = 0;
 	u32 lineno;
 
 	if (unlikely(protocol_min_failed(attr) ||
 		     !attr[IPSET_ATTR_SETNAME] ||
-		     !attr[IPSET_ATTR_DATA] ||
-		     !flag_nested(attr[IPSET_ATTR_DATA])))
+		     !((attr[IPSET_ATTR_DATA] != NULL) ^
+		       (attr[IPSET_ATTR_ADT] != NULL)) ||
+		     (attr[IPSET_ATTR_DATA] &&
+		      !flag_nested(attr[IPSET_ATTR_DATA])) ||
+		     (attr[IPSET_ATTR_ADT] &&
+		      (!flag_nested(attr[IPSET_ATTR_ADT]) ||
+		       !attr[IPSET_ATTR_LINENO]))))
 		return -IPSET_ERR_PROTOCOL;
 
 	set = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME]));
 	if (!set)
 		return -ENOENT;
 
-	if (nla_parse_nested(tb, IPSET_ATTR_ADT_MAX, attr[IPSET_ATTR_DATA],
-			     set->type->adt_policy, NULL))
-		return -IPSET_ERR_PROTOCOL;
+	if (attr[IPSET_ATTR_DATA]) {
+		if (nla_parse_nested(tb, IPSET_ATTR_ADT_MAX,
+				     attr[IPSET_ATTR_DATA],
+				     set->type->adt_policy, NULL))
+			return -IPSET_ERR_PROTOCOL;
 
-	rcu_read_lock_bh();
-	ret = set->variant->uadt(set, tb, IPSET_TEST, &lineno, 0, 0);
-	rcu_read_unlock_bh();
-	/* Userspace can't trigger element to be re-added */
-	if (ret == -EAGAIN)
-		ret = 1;
+		rcu_read_lock_bh();
+		ret = set->variant->uadt(set, tb, IPSET_TEST, &lineno, 0, 0);
+		rcu_read_unlock_bh();
+		/* Userspace can't trigger element to be re-added */
+		if (ret == -EAGAIN)
+			ret = 1;
+
+		return ret > 0 ? 0 : -IPSET_ERR_EXIST;
+	}
+
+	/* Batched test: succeeds when all elements are in the set,
+	 * otherwise the lineno of the first missing one is sent back.
+	 */
+	nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem) {
+		if (nla_type(nla) != IPSET_ATTR_DATA ||
+		    !flag_nested(nla) ||
+		    nla_parse_nested(tb, IPSET_ATTR_ADT_MAX, nla,
+				     set->type->adt_policy, NULL))
+			return -IPSET_ERR_PROTOCOL;
 
-	return ret > 0 ? 0 : -IPSET_ERR_EXIST;
+		lineno = 0;
+		rcu_read_lock_bh();
+		ret = set->variant->uadt(set, tb, IPSET_TEST, &lineno, 0, 0);
+		rcu_read_unlock_bh();
+		if (ret == -EAGAIN)
+			ret = 1;
+		if (ret <= 0) {
+			if (lineno)
+				return ip_set_report_lineno(ctnl, skb,
+							    -IPSET_ERR_EXIST,
+							    lineno);
+			return -IPSET_ERR_EXIST;
+		}
+	}
+	return 0;
 }
 
 /* Get headed data of a set */
@@ -227,7 +227,9 @@ htable_size(u8 hbits)
 #undef mtype_test_cidrs
 #undef mtype_test
 #undef mtype_uref
+#undef mtype_grow
 #undef mtype_resize
+#undef mtype_reserve
 #undef mtype_ext_size
 #undef mtype_resize_ad
 #undef mtype_head
@@ -271,7 +273,9 @@ htable_size(u8 hbits)
 #define mtype_test_cidrs	IPSET_TOKEN(MTYPE, _test_cidrs)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
 #define mtype_uref		IPSET_TOKEN(MTYPE, _uref)
+#define mtype_grow		IPSET_TOKEN(MTYPE, _grow)
 #define mtype_resize		IPSET_TOKEN(MTYPE, _resize)
+#define mtype_reserve		IPSET_TOKEN(MTYPE, _reserve)
 #define mtype_ext_size		IPSET_TOKEN(MTYPE, _ext_size)
 #define mtype_resize_ad		IPSET_TOKEN(MTYPE, _resize_ad)
 #define mtype_head		IPSET_TOKEN(MTYPE, _head)
@@ -620,12 +624,12 @@ static int
 mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	  struct ip_set_ext *mext, u32 flags);
 
-/* Resize a hash: create a new hash table with doubling the hashsize
- * and inserting the elements to it. Repeat until we succeed or
- * fail due to memory pressures.
+/* Grow a hash: create a new hash table with 2^grow times the hashsize
+ * and inserting the elements to it. Repeat with doubling the size until
+ * we succeed or fail due to memory pressures.
  */
 static int
-mtype_resize(struct ip_set *set, bool retried)
+mtype_grow(struct ip_set *set, u8 grow)
 {
 	struct htype *h = set->data;
 	struct htable *t, *orig;
@@ -649,7 +653,7 @@ mtype_resize(struct ip_set *set, bool retried)
 		return -ENOMEM;
 #endif
 	orig = ipset_dereference_bh_nfnl(h->table);
-	htable_bits = orig->htable_bits;
+	htable_bits = orig->htable_bits + grow - 1;
 
 retry:
 	ret = 0;
@@ -809,6 +813,40 @@ mtype_resize(struct ip_set *set, bool retried)
 	goto out;
 }
 
+/* Resize a hash by doubling the hashsize */
+static int
+mtype_resize(struct ip_set *set, bool retried)
+{
+	return mtype_grow(set, 1);
+}
+
+/* Make room for a batch of userspace adds in a single step, so that
+ * loading a large set does not rehash all elements at every doubling.
+ * Size the table to keep the buckets at AHASH_INIT_SIZE elements
+ * on average.
+ */
+static int
+mtype_reserve(struct ip_set *set, u32 nelems)
+{
+	struct htype *h = set->data;
+	const struct htable *t;
+	u32 r, elements = 0;
+	u64 buckets;
+	u8 grow = 0;
+
+	t = ipset_dereference_nfnl(h->table);
+	for (r = 0; r < ahash_numof_locks(t->htable_bits); r++)
+		elements += t->hregion[r].elements;
+
+	buckets = min_t(u64, (u64)elements + nelems, h->maxelem);
+	buckets = DIV_ROUND_UP_ULL(buckets, AHASH_INIT_SIZE);
+	while (t->htable_bits + grow < 32 &&
+	       jhash_size(t->htable_bits + grow) < buckets)
+		grow++;
+
+	return grow ? mtype_grow(set, grow) : 0;
+}
+
 /* Get the current number of elements and ext_size in the set  */
 static void
 mtype_ext_size(struct ip_set *set, u32 *elements, size_t *ext_size)
@@ -1432,6 +1470,7 @@ static const struct ip_set_type_variant mtype_variant = {
 	.list	= mtype_list,
 	.uref	= mtype_uref,
 	.resize	= mtype_resize,
+	.reserve = mtype_reserve,
 	.same_set = mtype_same_set,
 	.region_lock = true,
 };
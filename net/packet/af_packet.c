@@ -196,6 +196,7 @@ static int prb_queue_frozen(struct tpacket_kbdq_core *);
 static void prb_open_block(struct tpacket_kbdq_core *,
 		struct tpacket_block_desc *);
 static void prb_retire_rx_blk_timer_expired(struct timer_list *);
+static void prb_retire_cpu_blk_timer_expired(struct timer_list *);
 static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *);
 static void prb_fill_rxhash(struct tpacket_kbdq_core *, struct tpacket3_hdr *);
 static void prb_clear_rxhash(struct tpacket_kbdq_core *,
@@ -232,6 +233,21 @@ struct packet_skb_cb {
 	(((x)->kactive_blk_num < ((x)->knum_blocks-1)) ? \
 	((x)->kactive_blk_num+1) : 0)
 
+/* Block queue and lock of the rx ring the current CPU writes to */
+static struct tpacket_kbdq_core *packet_rx_bdqc(const struct packet_sock *po)
+{
+	if (po->rx_ring.cpu_rings)
+		return &po->rx_ring.cpu_rings[raw_smp_processor_id()].bdqc;
+	return GET_PBDQC_FROM_RB(&po->rx_ring);
+}
+
+static spinlock_t *packet_rx_lock(struct packet_sock *po)
+{
+	if (po->rx_ring.cpu_rings)
+		return &po->rx_ring.cpu_rings[raw_smp_processor_id()].lock;
+	return &po->sk.sk_receive_queue.lock;
+}
+
 static void __fanout_unlink(struct sock *sk, struct packet_sock *po);
 static void __fanout_link(struct sock *sk, struct packet_sock *po);
 
@@ -511,6 +527,21 @@ static void prb_shutdown_retire_blk_timer(struct packet_sock *po,
 	prb_del_retire_blk_timer(pkc);
 }
 
+static void prb_shutdown_cpu_rings(struct packet_cpu_ring *rings)
+{
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		struct packet_cpu_ring *ring = &rings[cpu];
+
+		spin_lock_bh(&ring->lock);
+		ring->bdqc.delete_blk_timer = 1;
+		spin_unlock_bh(&ring->lock);
+
+		prb_del_retire_blk_timer(&ring->bdqc);
+	}
+}
+
 static void prb_setup_retire_blk_timer(struct packet_sock *po)
 {
 	struct tpacket_kbdq_core *pkc;
@@ -570,7 +601,42 @@ static void prb_init_ft_ops(struct tpacket_kbdq_core *p1,
 	p1->feature_req_word = req_u->req3.tp_feature_req_word;
 }
 
-static void init_prb_bdqc(struct packet_sock *po,
+static struct packet_cpu_ring *init_prb_cpu_rings(struct packet_sock *po,
+			struct tpacket_kbdq_core *p1)
+{
+	unsigned int nr_blocks = p1->knum_blocks / nr_cpu_ids;
+	struct packet_cpu_ring *rings;
+	unsigned int cpu;
+
+	if (!nr_blocks || p1->knum_blocks % nr_cpu_ids)
+		return ERR_PTR(-EINVAL);
+
+	rings = kcalloc(nr_cpu_ids, sizeof(*rings), GFP_KERNEL);
+	if (!rings)
+		return ERR_PTR(-ENOMEM);
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		struct packet_cpu_ring *ring = &rings[cpu];
+		struct tpacket_kbdq_core *pkc = &ring->bdqc;
+		struct pgv *pg_vec = &p1->pkbdq[cpu * nr_blocks];
+
+		spin_lock_init(&ring->lock);
+		ring->po = po;
+
+		*pkc = *p1;
+		pkc->pkbdq = pg_vec;
+		pkc->pkblk_start = pg_vec[0].buffer;
+		pkc->knum_blocks = nr_blocks;
+		timer_setup(&pkc->retire_blk_timer,
+			    prb_retire_cpu_blk_timer_expired, 0);
+		pkc->retire_blk_timer.expires = jiffies;
+		prb_open_block(pkc, (struct tpacket_block_desc *)pg_vec[0].buffer);
+	}
+
+	return rings;
+}
+
+static struct packet_cpu_ring *init_prb_bdqc(struct packet_sock *po,
 			struct packet_ring_buffer *rb,
 			struct pgv *pg_vec,
 			union tpacket_req_u *req_u)
@@ -600,8 +666,14 @@ static void init_prb_bdqc(struct packet_sock *po,
 
 	p1->max_frame_len = p1->kblk_size - BLK_PLUS_PRIV(p1->blk_sizeof_priv);
 	prb_init_ft_ops(p1, req_u);
+
+	/* The per-CPU queues take over, p1 only serves as their template */
+	if (p1->feature_req_word & TP_FT_REQ_PER_CPU)
+		return init_prb_cpu_rings(po, p1);
+
 	prb_setup_retire_blk_timer(po);
 	prb_open_block(p1, pbd);
+	return NULL;
 }
 
 /*  Do NOT update the last_blk_num first.
@@ -637,15 +709,14 @@ static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *pkc)
  * prb_calc_retire_blk_tmo() calculates the tmo.
  *
  */
-static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
+static void prb_retire_rx_blk(struct packet_sock *po,
+			      struct tpacket_kbdq_core *pkc,
+			      spinlock_t *lock)
 {
-	struct packet_sock *po =
-		from_timer(po, t, rx_ring.prb_bdqc.retire_blk_timer);
-	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
 	unsigned int frozen;
 	struct tpacket_block_desc *pbd;
 
-	spin_lock(&po->sk.sk_receive_queue.lock);
+	spin_lock(lock);
 
 	frozen = prb_queue_frozen(pkc);
 	pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
@@ -708,7 +779,24 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 	_prb_refresh_rx_retire_blk_timer(pkc);
 
 out:
-	spin_unlock(&po->sk.sk_receive_queue.lock);
+	spin_unlock(lock);
+}
+
+static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
+{
+	struct packet_sock *po =
+		from_timer(po, t, rx_ring.prb_bdqc.retire_blk_timer);
+
+	prb_retire_rx_blk(po, GET_PBDQC_FROM_RB(&po->rx_ring),
+			  &po->sk.sk_receive_queue.lock);
+}
+
+static void prb_retire_cpu_blk_timer_expired(struct timer_list *t)
+{
+	struct packet_cpu_ring *ring =
+		from_timer(ring, t, bdqc.retire_blk_timer);
+
+	prb_retire_rx_blk(ring->po, &ring->bdqc, &ring->lock);
 }
 
 static void prb_flush_block(struct tpacket_kbdq_core *pkc1,
@@ -872,7 +960,11 @@ static void prb_freeze_queue(struct tpacket_kbdq_core *pkc,
 				  struct packet_sock *po)
 {
 	pkc->reset_pending_on_curr_blk = 1;
-	po->stats.stats3.tp_freeze_q_cnt++;
+	if (po->rx_ring.cpu_rings)
+		container_of(pkc, struct packet_cpu_ring,
+			     bdqc)->stats.tp_freeze_q_cnt++;
+	else
+		po->stats.stats3.tp_freeze_q_cnt++;
 }
 
 #define TOTAL_PKT_LEN_INCL_ALIGN(length) (ALIGN((length), V3_ALIGNMENT))
@@ -945,10 +1037,10 @@ static int prb_queue_frozen(struct tpacket_kbdq_core *pkc)
 	return pkc->reset_pending_on_curr_blk;
 }
 
-static void prb_clear_blk_fill_status(struct packet_ring_buffer *rb)
+static void prb_clear_blk_fill_status(struct packet_sock *po)
 	__releases(&pkc->blk_fill_in_prog_lock)
 {
-	struct tpacket_kbdq_core *pkc  = GET_PBDQC_FROM_RB(rb);
+	struct tpacket_kbdq_core *pkc  = packet_rx_bdqc(po);
 	atomic_dec(&pkc->blk_fill_in_prog);
 }
 
@@ -1008,7 +1100,7 @@ static void prb_fill_curr_block(char *curr,
 	prb_run_all_ft_ops(pkc, ppd);
 }
 
-/* Assumes caller has the sk->rx_queue.lock */
+/* Assumes caller has the packet_rx_lock() */
 static void *__packet_lookup_frame_in_block(struct packet_sock *po,
 					    struct sk_buff *skb,
 					    unsigned int len
@@ -1018,7 +1110,7 @@ static void *__packet_lookup_frame_in_block(struct packet_sock *po,
 	struct tpacket_block_desc *pbd;
 	char *curr, *end;
 
-	pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	pkc = packet_rx_bdqc(po);
 	pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
 
 	/* Queue is frozen when user space is lagging behind */
@@ -1090,12 +1182,10 @@ static void *packet_current_rx_frame(struct packet_sock *po,
 	}
 }
 
-static void *prb_lookup_block(const struct packet_sock *po,
-			      const struct packet_ring_buffer *rb,
+static void *prb_lookup_block(const struct tpacket_kbdq_core *pkc,
 			      unsigned int idx,
 			      int status)
 {
-	struct tpacket_kbdq_core *pkc  = GET_PBDQC_FROM_RB(rb);
 	struct tpacket_block_desc *pbd = GET_PBLOCK_DESC(pkc, idx);
 
 	if (status != BLOCK_STATUS(pbd))
@@ -1103,23 +1193,42 @@ static void *prb_lookup_block(const struct packet_sock *po,
 	return pbd;
 }
 
-static int prb_previous_blk_num(struct packet_ring_buffer *rb)
+static int prb_previous_blk_num(struct tpacket_kbdq_core *pkc)
 {
 	unsigned int prev;
-	if (rb->prb_bdqc.kactive_blk_num)
-		prev = rb->prb_bdqc.kactive_blk_num-1;
+	if (pkc->kactive_blk_num)
+		prev = pkc->kactive_blk_num-1;
 	else
-		prev = rb->prb_bdqc.knum_blocks-1;
+		prev = pkc->knum_blocks-1;
 	return prev;
 }
 
 /* Assumes caller has held the rx_queue.lock */
-static void *__prb_previous_block(struct packet_sock *po,
-					 struct packet_ring_buffer *rb,
+static void *__prb_previous_block(struct tpacket_kbdq_core *pkc,
 					 int status)
 {
-	unsigned int previous = prb_previous_blk_num(rb);
-	return prb_lookup_block(po, rb, previous, status);
+	unsigned int previous = prb_previous_blk_num(pkc);
+	return prb_lookup_block(pkc, previous, status);
+}
+
+/* With per-CPU queues, NULL is returned as soon as the previous block of
+ * one of them does not match @status.
+ */
+static void *__prb_previous_cpu_block(struct packet_cpu_ring *rings,
+					     int status)
+{
+	unsigned int cpu;
+	void *pbd;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		spin_lock(&rings[cpu].lock);
+		pbd = __prb_previous_block(&rings[cpu].bdqc, status);
+		spin_unlock(&rings[cpu].lock);
+		if (!pbd)
+			return NULL;
+	}
+
+	return pbd;
 }
 
 static void *packet_previous_rx_frame(struct packet_sock *po,
@@ -1129,7 +1238,10 @@ static void *packet_previous_rx_frame(struct packet_sock *po,
 	if (po->tp_version <= TPACKET_V2)
 		return packet_previous_frame(po, rb, status);
 
-	return __prb_previous_block(po, rb, status);
+	if (rb->cpu_rings)
+		return __prb_previous_cpu_block(rb->cpu_rings, status);
+
+	return __prb_previous_block(GET_PBDQC_FROM_RB(rb), status);
 }
 
 static void packet_increment_rx_head(struct packet_sock *po,
@@ -1219,17 +1331,38 @@ static bool __tpacket_has_room(const struct packet_sock *po, int pow_off)
 	return packet_lookup_frame(po, &po->rx_ring, idx, TP_STATUS_KERNEL);
 }
 
-static bool __tpacket_v3_has_room(const struct packet_sock *po, int pow_off)
+static bool __prb_has_room(const struct tpacket_kbdq_core *pkc, int pow_off)
 {
 	int idx, len;
 
-	len = READ_ONCE(po->rx_ring.prb_bdqc.knum_blocks);
-	idx = READ_ONCE(po->rx_ring.prb_bdqc.kactive_blk_num);
+	len = READ_ONCE(pkc->knum_blocks);
+	idx = READ_ONCE(pkc->kactive_blk_num);
 	if (pow_off)
 		idx += len >> pow_off;
 	if (idx >= len)
 		idx -= len;
-	return prb_lookup_block(po, &po->rx_ring, idx, TP_STATUS_KERNEL);
+	return prb_lookup_block(pkc, idx, TP_STATUS_KERNEL);
+}
+
+/*
+ * With per-CPU block queues, a packet (@skb) only needs room in the queue of
+ * the CPU receiving it, but the socket as a whole only has room once every
+ * queue has.
+ */
+static bool __tpacket_v3_has_room(const struct packet_sock *po,
+				  const struct sk_buff *skb, int pow_off)
+{
+	const struct packet_cpu_ring *rings = po->rx_ring.cpu_rings;
+	unsigned int cpu;
+
+	if (!rings || skb)
+		return __prb_has_room(packet_rx_bdqc(po), pow_off);
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		if (!__prb_has_room(&rings[cpu].bdqc, pow_off))
+			return false;
+
+	return true;
 }
 
 static int __packet_rcv_has_room(const struct packet_sock *po,
@@ -1252,9 +1385,9 @@ static int __packet_rcv_has_room(const struct packet_sock *po,
 	}
 
 	if (po->tp_version == TPACKET_V3) {
-		if (__tpacket_v3_has_room(po, ROOM_POW_OFF))
+		if (__tpacket_v3_has_room(po, skb, ROOM_POW_OFF))
 			ret = ROOM_NORMAL;
-		else if (__tpacket_v3_has_room(po, 0))
+		else if (__tpacket_v3_has_room(po, skb, 0))
 			ret = ROOM_LOW;
 	} else {
 		if (__tpacket_has_room(po, ROOM_POW_OFF))
@@ -2193,6 +2326,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	bool is_drop_n_account = false;
 	unsigned int slot_id = 0;
 	bool do_vnet = false;
+	spinlock_t *rx_lock;
 
 	/* struct tpacket{2,3}_hdr is aligned to a multiple of TPACKET_ALIGNMENT.
 	 * We may add members to them until current aligned size without forcing
@@ -2294,7 +2428,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 			do_vnet = false;
 		}
 	}
-	spin_lock(&sk->sk_receive_queue.lock);
+	rx_lock = packet_rx_lock(po);
+	spin_lock(rx_lock);
 	h.raw = packet_current_rx_frame(po, skb,
 					TP_STATUS_KERNEL, (macoff+snaplen));
 	if (!h.raw)
@@ -2312,7 +2447,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 				    sizeof(struct virtio_net_hdr),
 				    vio_le(), true, 0)) {
 		if (po->tp_version == TPACKET_V3)
-			prb_clear_blk_fill_status(&po->rx_ring);
+			prb_clear_blk_fill_status(po);
 		goto drop_n_account;
 	}
 
@@ -2328,12 +2463,16 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 			status |= TP_STATUS_LOSING;
 	}
 
-	po->stats.stats1.tp_packets++;
+	if (po->rx_ring.cpu_rings)
+		container_of(rx_lock, struct packet_cpu_ring,
+			     lock)->stats.tp_packets++;
+	else
+		po->stats.stats1.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
 		__skb_queue_tail(&sk->sk_receive_queue, copy_skb);
 	}
-	spin_unlock(&sk->sk_receive_queue.lock);
+	spin_unlock(rx_lock);
 
 	skb_copy_bits(skb, 0, h.raw + macoff, snaplen);
 
@@ -2421,7 +2560,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		spin_unlock(&sk->sk_receive_queue.lock);
 		sk->sk_data_ready(sk);
 	} else if (po->tp_version == TPACKET_V3) {
-		prb_clear_blk_fill_status(&po->rx_ring);
+		prb_clear_blk_fill_status(po);
 	}
 
 drop_n_restore:
@@ -2437,7 +2576,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	return 0;
 
 drop_n_account:
-	spin_unlock(&sk->sk_receive_queue.lock);
+	spin_unlock(rx_lock);
 	atomic_inc(&po->tp_drops);
 	is_drop_n_account = true;
 
@@ -3959,6 +4098,30 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 	}
 }
 
+/* Collect and clear the counters of the per-CPU rx queues */
+static void packet_fold_cpu_ring_stats(struct packet_sock *po,
+				       struct tpacket_stats_v3 *st)
+{
+	struct packet_cpu_ring *ring;
+	unsigned int cpu;
+
+	mutex_lock(&po->pg_vec_lock);
+	if (!po->rx_ring.cpu_rings)
+		goto out;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		ring = &po->rx_ring.cpu_rings[cpu];
+
+		spin_lock_bh(&ring->lock);
+		st->tp_packets += ring->stats.tp_packets;
+		st->tp_freeze_q_cnt += ring->stats.tp_freeze_q_cnt;
+		memset(&ring->stats, 0, sizeof(ring->stats));
+		spin_unlock_bh(&ring->lock);
+	}
+out:
+	mutex_unlock(&po->pg_vec_lock);
+}
+
 static int packet_getsockopt(struct socket *sock, int level, int optname,
 			     char __user *optval, int __user *optlen)
 {
@@ -3986,6 +4149,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		memcpy(&st, &po->stats, sizeof(st));
 		memset(&po->stats, 0, sizeof(po->stats));
 		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		packet_fold_cpu_ring_stats(po, &st.stats3);
 		drops = atomic_xchg(&po->tp_drops, 0);
 
 		if (po->tp_version == TPACKET_V3) {
@@ -4329,6 +4493,7 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 {
 	struct pgv *pg_vec = NULL;
 	struct packet_sock *po = pkt_sk(sk);
+	struct packet_cpu_ring *cpu_rings = NULL;
 	unsigned long *rx_owner_map = NULL;
 	int was_running, order = 0;
 	struct packet_ring_buffer *rb;
@@ -4402,7 +4567,12 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		case TPACKET_V3:
 			/* Block transmit is not supported yet */
 			if (!tx_ring) {
-				init_prb_bdqc(po, rb, pg_vec, req_u);
+				cpu_rings = init_prb_bdqc(po, rb, pg_vec, req_u);
+				if (IS_ERR(cpu_rings)) {
+					err = PTR_ERR(cpu_rings);
+					cpu_rings = NULL;
+					goto out_free_pg_vec;
+				}
 			} else {
 				struct tpacket_req3 *req3 = &req_u->req3;
 
@@ -4452,6 +4622,8 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		swap(rb->pg_vec, pg_vec);
 		if (po->tp_version <= TPACKET_V2)
 			swap(rb->rx_owner_map, rx_owner_map);
+		else if (!tx_ring)
+			swap(rb->cpu_rings, cpu_rings);
 		rb->frame_max = (req->tp_frame_nr - 1);
 		rb->head = 0;
 		rb->frame_size = req->tp_frame_size;
@@ -4478,13 +4650,18 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 	spin_unlock(&po->bind_lock);
 	if (pg_vec && (po->tp_version > TPACKET_V2)) {
 		/* Because we don't support block-based V3 on tx-ring */
-		if (!tx_ring)
-			prb_shutdown_retire_blk_timer(po, rb_queue);
+		if (!tx_ring) {
+			if (cpu_rings)
+				prb_shutdown_cpu_rings(cpu_rings);
+			else
+				prb_shutdown_retire_blk_timer(po, rb_queue);
+		}
 	}
 
 out_free_pg_vec:
 	if (pg_vec) {
 		bitmap_free(rx_owner_map);
+		kfree(cpu_rings);
 		free_pg_vec(pg_vec, order, req->tp_block_nr);
 	}
 out:
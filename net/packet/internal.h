@@ -56,6 +56,25 @@ struct pgv {
 	char *buffer;
 };
 
+/* Feature request for TPACKET_V3 rx rings: give each CPU its own block
+ * queue.  The tp_block_nr blocks are split evenly over nr_cpu_ids, so
+ * CPU n fills blocks [n * tp_block_nr / nr_cpu_ids, (n + 1) * ...) and
+ * packets never contend on another CPU's block.
+ */
+#ifndef TP_FT_REQ_PER_CPU
+#define TP_FT_REQ_PER_CPU	0x2
+#endif
+
+struct packet_sock;
+
+struct packet_cpu_ring {
+	struct tpacket_kbdq_core	bdqc;
+	/* protects bdqc and stats, in place of sk_receive_queue.lock */
+	spinlock_t			lock;
+	struct packet_sock		*po;
+	struct tpacket_stats_v3		stats;
+} ____cacheline_aligned_in_smp;
+
 struct packet_ring_buffer {
 	struct pgv		*pg_vec;
 
@@ -70,6 +89,9 @@ struct packet_ring_buffer {
 
 	unsigned int __percpu	*pending_refcnt;
 
+	/* rx only, one entry per possible CPU id with TP_FT_REQ_PER_CPU */
+	struct packet_cpu_ring	*cpu_rings;
+
 	union {
 		unsigned long			*rx_owner_map;
 		struct tpacket_kbdq_core	prb_bdqc;
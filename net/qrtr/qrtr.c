@@ -12,6 +12,7 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/rwsem.h>
+#include <linux/xarray.h>
 #include <linux/uidgid.h>
 #include <linux/pm_wakeup.h>
 #include <linux/ipc_logging.h>
@@ -114,6 +115,10 @@ struct qrtr_sock {
 	struct sockaddr_qrtr peer;
 
 	int state;
+
+	/* set while the rx worker holds back the wakeup of a batch */
+	bool defer_wake;
+	void (*data_ready)(struct sock *sk);
 };
 
 static inline struct qrtr_sock *qrtr_sk(struct sock *sk)
@@ -125,16 +130,19 @@ static inline struct qrtr_sock *qrtr_sk(struct sock *sk)
 static unsigned int qrtr_local_nid = CONFIG_QRTR_NODE_ID;
 static unsigned int qrtr_wakeup_ms = CONFIG_QRTR_WAKEUP_MS;
 
-/* for node ids */
-static RADIX_TREE(qrtr_nodes, GFP_ATOMIC);
+/* for node ids, lookups are done under RCU */
+static DEFINE_XARRAY(qrtr_nodes);
+/* serializes updates of qrtr_nodes */
 static DEFINE_SPINLOCK(qrtr_nodes_lock);
 /* broadcast list */
 static LIST_HEAD(qrtr_all_epts);
 /* lock for qrtr_all_epts */
 static DECLARE_RWSEM(qrtr_epts_lock);
 
-/* local port allocation management */
-static DEFINE_IDR(qrtr_ports);
+/* local port allocation management, lookups are done under RCU */
+static DEFINE_XARRAY_ALLOC(qrtr_ports);
+static u32 qrtr_ports_next = QRTR_MIN_EPH_SOCKET;
+/* serializes updates of qrtr_ports */
 static DEFINE_SPINLOCK(qrtr_port_lock);
 
 /* backup buffers */
@@ -167,6 +175,7 @@ static struct work_struct qrtr_backup_work;
  * @say_hello: scheduled work for initiating hello
  * @ws: wakeupsource avoid system suspend
  * @ilc: ipc logging context reference
+ * @rcu: deferred free for lockless lookups
  */
 struct qrtr_node {
 	struct mutex ep_lock;
@@ -193,6 +202,8 @@ struct qrtr_node {
 	void *ilc;
 
 	u32 nonwake_svc[MAX_NON_WAKE_SVC_LEN];
+
+	struct rcu_head rcu;
 };
 
 struct qrtr_tx_flow_waiter {
@@ -215,6 +226,9 @@ struct qrtr_tx_flow {
 #define QRTR_TX_FLOW_HIGH	10
 #define QRTR_TX_FLOW_LOW	5
 
+/* packets queued to one socket by the rx worker before waking its reader */
+#define QRTR_RX_BATCH		32
+
 static struct sk_buff *qrtr_alloc_ctrl_packet(struct qrtr_ctrl_pkt **pkt);
 static int qrtr_local_enqueue(struct qrtr_node *node, struct sk_buff *skb,
 			      int type, struct sockaddr_qrtr *from,
@@ -386,15 +400,16 @@ static void __qrtr_node_release(struct kref *kref)
 	struct radix_tree_iter iter;
 	struct qrtr_tx_flow *flow;
 	struct qrtr_node *node = container_of(kref, struct qrtr_node, ref);
+	struct qrtr_node *entry;
 	unsigned long flags;
+	unsigned long index;
 	void __rcu **slot;
 
 	spin_lock_irqsave(&qrtr_nodes_lock, flags);
 	if (node->nid != QRTR_EP_NID_AUTO) {
-		radix_tree_for_each_slot(slot, &qrtr_nodes, &iter, 0) {
-			if (node == *slot)
-				radix_tree_iter_delete(&qrtr_nodes, &iter,
-						       slot);
+		xa_for_each(&qrtr_nodes, index, entry) {
+			if (node == entry)
+				xa_erase(&qrtr_nodes, index);
 		}
 	}
 	spin_unlock_irqrestore(&qrtr_nodes_lock, flags);
@@ -421,15 +436,9 @@ static void __qrtr_node_release(struct kref *kref)
 	kthread_stop(node->task);
 
 	skb_queue_purge(&node->rx_queue);
-	kfree(node);
-}
 
-/* Increment reference to node. */
-static struct qrtr_node *qrtr_node_acquire(struct qrtr_node *node)
-{
-	if (node)
-		kref_get(&node->ref);
-	return node;
+	/* qrtr_node_lookup() may still be looking at the node */
+	kfree_rcu(node, rcu);
 }
 
 /* Decrement reference to node and release as necessary. */
@@ -693,14 +702,15 @@ static int qrtr_node_enqueue(struct qrtr_node *node, struct sk_buff *skb,
 static struct qrtr_node *qrtr_node_lookup(unsigned int nid)
 {
 	struct qrtr_node *node;
-	unsigned long flags;
 
-	down_read(&qrtr_epts_lock);
-	spin_lock_irqsave(&qrtr_nodes_lock, flags);
-	node = radix_tree_lookup(&qrtr_nodes, nid);
-	node = qrtr_node_acquire(node);
-	spin_unlock_irqrestore(&qrtr_nodes_lock, flags);
-	up_read(&qrtr_epts_lock);
+	/* A node whose last reference is being dropped is skipped, its
+	 * memory stays valid until the end of the grace period.
+	 */
+	rcu_read_lock();
+	node = xa_load(&qrtr_nodes, nid);
+	if (node && !kref_get_unless_zero(&node->ref))
+		node = NULL;
+	rcu_read_unlock();
 
 	return node;
 }
@@ -718,8 +728,8 @@ static void qrtr_node_assign(struct qrtr_node *node, unsigned int nid)
 		return;
 
 	spin_lock_irqsave(&qrtr_nodes_lock, flags);
-	if (!radix_tree_lookup(&qrtr_nodes, nid))
-		radix_tree_insert(&qrtr_nodes, nid, node);
+	if (!xa_load(&qrtr_nodes, nid))
+		xa_store(&qrtr_nodes, nid, node, GFP_ATOMIC);
 
 	if (node->nid == QRTR_EP_NID_AUTO)
 		node->nid = nid;
@@ -1069,7 +1079,7 @@ static void qrtr_fwd_pkt(struct sk_buff *skb, struct qrtr_cb *cb)
 	qrtr_node_release(node);
 }
 
-static void qrtr_sock_queue_skb(struct qrtr_node *node, struct sk_buff *skb,
+static bool qrtr_sock_queue_skb(struct qrtr_node *node, struct sk_buff *skb,
 				struct qrtr_sock *ipc)
 {
 	struct qrtr_cb *cb = (struct qrtr_cb *)skb->cb;
@@ -1079,7 +1089,7 @@ static void qrtr_sock_queue_skb(struct qrtr_node *node, struct sk_buff *skb,
 	if (cb->type == QRTR_TYPE_HELLO) {
 		if (atomic_read(&node->hello_rcvd)) {
 			kfree_skb(skb);
-			return;
+			return false;
 		}
 		atomic_inc(&node->hello_rcvd);
 	}
@@ -1089,7 +1099,36 @@ static void qrtr_sock_queue_skb(struct qrtr_node *node, struct sk_buff *skb,
 		pr_err("%s: qrtr pkt dropped flow[%d] rc[%d]\n",
 		       __func__, cb->confirm_rx, rc);
 		kfree_skb(skb);
+		return false;
 	}
+
+	return true;
+}
+
+/* Hold back the wakeups of the packets queued to @ipc by the rx worker, the
+ * worker wakes up the reader once for all of them through qrtr_sock_wake().
+ * If the worker of another node ends its batch first, the rest of the packets
+ * just wake up the reader one by one again.
+ */
+static void qrtr_sk_data_ready(struct sock *sk)
+{
+	struct qrtr_sock *ipc = qrtr_sk(sk);
+
+	if (!READ_ONCE(ipc->defer_wake))
+		ipc->data_ready(sk);
+}
+
+/* Wake up the reader of @ipc once for all the packets queued to it and drop
+ * the port reference taken by the batch.
+ */
+static void qrtr_sock_wake(struct qrtr_sock *ipc, unsigned int queued)
+{
+	struct sock *sk = &ipc->sk;
+
+	WRITE_ONCE(ipc->defer_wake, false);
+	if (queued && !sock_flag(sk, SOCK_DEAD))
+		sk->sk_data_ready(sk);
+	qrtr_port_put(ipc);
 }
 
 /* Handle not atomic operations for a received packet. */
@@ -1097,6 +1136,8 @@ static void qrtr_node_rx_work(struct kthread_work *work)
 {
 	struct qrtr_node *node = container_of(work, struct qrtr_node,
 					      read_data);
+	struct qrtr_sock *batch = NULL;
+	unsigned int queued = 0;
 	struct sk_buff *skb;
 	char name[32] = {0,};
 
@@ -1109,6 +1150,15 @@ static void qrtr_node_rx_work(struct kthread_work *work)
 		struct qrtr_cb *cb = (struct qrtr_cb *)skb->cb;
 		struct qrtr_sock *ipc;
 
+		/* Only local DATA packets join a batch, don't hold a wakeup
+		 * back while forwarding or handling anything else.
+		 */
+		if (batch && (cb->type != QRTR_TYPE_DATA ||
+			      cb->dst_node != qrtr_local_nid)) {
+			qrtr_sock_wake(batch, queued);
+			batch = NULL;
+		}
+
 		if (cb->type != QRTR_TYPE_DATA)
 			qrtr_fwd_ctrl_pkt(node, skb);
 
@@ -1125,12 +1175,32 @@ static void qrtr_node_rx_work(struct kthread_work *work)
 			ipc = qrtr_port_lookup(cb->dst_port);
 			if (!ipc) {
 				kfree_skb(skb);
-			} else {
-				qrtr_sock_queue_skb(node, skb, ipc);
+				continue;
+			}
+
+			/* Consecutive packets for the same socket share a
+			 * single wakeup of the reader.
+			 */
+			if (ipc == batch) {
 				qrtr_port_put(ipc);
+			} else {
+				if (batch)
+					qrtr_sock_wake(batch, queued);
+				batch = ipc;
+				queued = 0;
+				WRITE_ONCE(batch->defer_wake, true);
+			}
+
+			if (qrtr_sock_queue_skb(node, skb, batch) &&
+			    ++queued >= QRTR_RX_BATCH) {
+				qrtr_sock_wake(batch, queued);
+				batch = NULL;
 			}
 		}
 	}
+
+	if (batch)
+		qrtr_sock_wake(batch, queued);
 }
 
 static void qrtr_hello_work(struct kthread_work *work)
@@ -1298,10 +1368,9 @@ static void qrtr_fwd_del_proc(struct qrtr_node *src, unsigned int nid)
  */
 void qrtr_endpoint_unregister(struct qrtr_endpoint *ep)
 {
-	struct radix_tree_iter iter;
 	struct qrtr_node *node = ep->node;
-	unsigned long flags;
-	void __rcu **slot;
+	struct qrtr_node *entry;
+	unsigned long index;
 
 	mutex_lock(&node->ep_lock);
 	node->ep = NULL;
@@ -1309,19 +1378,13 @@ void qrtr_endpoint_unregister(struct qrtr_endpoint *ep)
 
 	/* Notify the local controller about the event */
 	down_read(&qrtr_epts_lock);
-	spin_lock_irqsave(&qrtr_nodes_lock, flags);
-	radix_tree_for_each_slot(slot, &qrtr_nodes, &iter, 0) {
-		if (node != *slot)
+	xa_for_each(&qrtr_nodes, index, entry) {
+		if (node != entry)
 			continue;
 
-		spin_unlock_irqrestore(&qrtr_nodes_lock, flags);
-
-		qrtr_notify_bye(iter.index);
-		qrtr_fwd_del_proc(node, iter.index);
-
-		spin_lock_irqsave(&qrtr_nodes_lock, flags);
+		qrtr_notify_bye(index);
+		qrtr_fwd_del_proc(node, index);
 	}
-	spin_unlock_irqrestore(&qrtr_nodes_lock, flags);
 	up_read(&qrtr_epts_lock);
 
 	/* Wake up any transmitters waiting for resume-tx from the node */
@@ -1339,16 +1402,18 @@ EXPORT_SYMBOL_GPL(qrtr_endpoint_unregister);
 static struct qrtr_sock *qrtr_port_lookup(int port)
 {
 	struct qrtr_sock *ipc;
-	unsigned long flags;
 
 	if (port == QRTR_PORT_CTRL)
 		port = 0;
 
-	spin_lock_irqsave(&qrtr_port_lock, flags);
-	ipc = idr_find(&qrtr_ports, port);
-	if (ipc)
-		sock_hold(&ipc->sk);
-	spin_unlock_irqrestore(&qrtr_port_lock, flags);
+	/* Sockets are freed after a grace period (SOCK_RCU_FREE), so only
+	 * a socket that is already on its way out can be seen here.
+	 */
+	rcu_read_lock();
+	ipc = xa_load(&qrtr_ports, port);
+	if (ipc && !refcount_inc_not_zero(&ipc->sk.sk_refcnt))
+		ipc = NULL;
+	rcu_read_unlock();
 
 	return ipc;
 }
@@ -1419,7 +1484,7 @@ static void qrtr_port_remove(struct qrtr_sock *ipc)
 	__sock_put(&ipc->sk);
 
 	spin_lock_irqsave(&qrtr_port_lock, flags);
-	idr_remove(&qrtr_ports, port);
+	xa_erase(&qrtr_ports, port);
 	spin_unlock_irqrestore(&qrtr_port_lock, flags);
 }
 
@@ -1435,28 +1500,28 @@ static void qrtr_port_remove(struct qrtr_sock *ipc)
  */
 static int qrtr_port_assign(struct qrtr_sock *ipc, int *port)
 {
+	u32 id;
 	int rc;
 
 	if (!*port) {
-		rc = idr_alloc_cyclic(&qrtr_ports, ipc, QRTR_MIN_EPH_SOCKET,
-				      QRTR_MAX_EPH_SOCKET + 1, GFP_ATOMIC);
+		rc = xa_alloc_cyclic(&qrtr_ports, &id, ipc,
+				     XA_LIMIT(QRTR_MIN_EPH_SOCKET,
+					      QRTR_MAX_EPH_SOCKET),
+				     &qrtr_ports_next, GFP_ATOMIC);
 		if (rc >= 0)
-			*port = rc;
+			*port = id;
 	} else if (*port < QRTR_MIN_EPH_SOCKET &&
 			!(capable(CAP_NET_ADMIN) ||
 			in_egroup_p(AID_VENDOR_QRTR) ||
 			in_egroup_p(GLOBAL_ROOT_GID))) {
 		rc = -EACCES;
 	} else if (*port == QRTR_PORT_CTRL) {
-		rc = idr_alloc(&qrtr_ports, ipc, 0, 1, GFP_ATOMIC);
+		rc = xa_insert(&qrtr_ports, 0, ipc, GFP_ATOMIC);
 	} else {
-		rc = idr_alloc_cyclic(&qrtr_ports, ipc, *port, *port + 1,
-				      GFP_ATOMIC);
-		if (rc >= 0)
-			*port = rc;
+		rc = xa_insert(&qrtr_ports, *port, ipc, GFP_ATOMIC);
 	}
 
-	if (rc == -ENOSPC)
+	if (rc == -EBUSY)
 		return -EADDRINUSE;
 	else if (rc < 0)
 		return rc;
@@ -1470,9 +1535,9 @@ static int qrtr_port_assign(struct qrtr_sock *ipc, int *port)
 static void qrtr_reset_ports(void)
 {
 	struct qrtr_sock *ipc;
-	int id;
+	unsigned long id;
 
-	idr_for_each_entry(&qrtr_ports, ipc, id) {
+	xa_for_each(&qrtr_ports, id, ipc) {
 		/* Don't reset control port */
 		if (id == 0)
 			continue;
@@ -1658,7 +1723,8 @@ static int qrtr_sendmsg(struct socket *sock, struct msghdr *msg, size_t len)
 	u32 type;
 	int rc;
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT))
+	/* sendmmsg() flags all but the last datagram with MSG_BATCH */
+	if (msg->msg_flags & ~(MSG_DONTWAIT | MSG_BATCH))
 		return -EINVAL;
 
 	if (len > 65535)
@@ -2042,11 +2108,15 @@ static int qrtr_create(struct net *net, struct socket *sock,
 		return -ENOMEM;
 
 	sock_set_flag(sk, SOCK_ZAPPED);
+	/* qrtr_port_lookup() is lockless */
+	sock_set_flag(sk, SOCK_RCU_FREE);
 
 	sock_init_data(sock, sk);
 	sock->ops = &qrtr_proto_ops;
 
 	ipc = qrtr_sk(sk);
+	ipc->data_ready = sk->sk_data_ready;
+	sk->sk_data_ready = qrtr_sk_data_ready;
 	ipc->us.sq_family = AF_QIPCRTR;
 	ipc->us.sq_node = qrtr_local_nid;
 	ipc->us.sq_port = 0;
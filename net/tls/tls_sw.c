@@ -128,8 +128,13 @@ static int skb_nsg(struct sk_buff *skb, int offset, int len)
         return __skb_nsg(skb, offset, len, 0);
 }
 
-static int padding_length(struct tls_sw_context_rx *ctx,
-			  struct tls_prot_info *prot, struct sk_buff *skb)
+/* For TLS 1.3 the real record type is the last non-zero byte of the
+ * plaintext; store it in *control. Async completions pass the per-record
+ * tls_msg(skb)->control so they never race with the parser updating
+ * ctx->control for the next record.
+ */
+static int padding_length(struct tls_prot_info *prot, struct sk_buff *skb,
+			  u8 *control)
 {
 	struct strp_msg *rxm = strp_msg(skb);
 	int sub = 0;
@@ -153,7 +158,7 @@ static int padding_length(struct tls_sw_context_rx *ctx,
 			sub++;
 			back++;
 		}
-		ctx->control = content_type;
+		*control = content_type;
 	}
 	return sub;
 }
@@ -184,7 +189,7 @@ static void tls_decrypt_done(struct crypto_async_request *req, int err)
 		struct strp_msg *rxm = strp_msg(skb);
 		int pad;
 
-		pad = padding_length(ctx, prot, skb);
+		pad = padding_length(prot, skb, &tls_msg(skb)->control);
 		if (pad < 0) {
 			ctx->async_wait.err = pad;
 			tls_err_abort(skb->sk, pad);
@@ -1578,7 +1583,7 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 			*zc = false;
 		}
 
-		pad = padding_length(ctx, prot, skb);
+		pad = padding_length(prot, skb, &ctx->control);
 		if (pad < 0)
 			return pad;
 
@@ -1750,6 +1755,7 @@ int tls_sw_recvmsg(struct sock *sk,
 	struct sk_psock *psock;
 	unsigned char control = 0;
 	ssize_t decrypted = 0;
+	ssize_t decrypted_sync = 0;
 	struct strp_msg *rxm;
 	struct tls_msg *tlm;
 	struct sk_buff *skb;
@@ -1842,18 +1848,33 @@ int tls_sw_recvmsg(struct sock *sk,
 		}
 
 		if (err == -EINPROGRESS) {
+			/* Bytes already copied into msg ahead of the first
+			 * record that went async.
+			 */
+			if (!num_async)
+				decrypted_sync = decrypted;
 			async = true;
 			num_async++;
 		} else if (prot->version == TLS_1_3_VERSION) {
 			tlm->control = ctx->control;
 		}
 
+		/* A tls1.3 record only reveals its type once decrypted. While
+		 * earlier records are still in flight, queue this one behind
+		 * them even if it completed synchronously; process_rx_list()
+		 * checks the types in record order once they have all landed.
+		 */
+		if (prot->version == TLS_1_3_VERSION && num_async) {
+			async = true;
+			goto pick_next_record;
+		}
+
 		/* If the type of records being processed is not known yet,
 		 * set it to record type just dequeued. If it is already known,
 		 * but does not match the record type just dequeued, go to end.
 		 * We always get record type here since for tls1.2, record type
-		 * is known just after record is dequeued from stream parser.
-		 * For tls1.3, we disable async.
+		 * is known just after record is dequeued from stream parser,
+		 * and tls1.3 records only get here when decrypted synchronously.
 		 */
 
 		if (!control)
@@ -1929,7 +1950,7 @@ int tls_sw_recvmsg(struct sock *sk,
 			 * another message type
 			 */
 			msg->msg_flags |= MSG_EOR;
-			if (control != TLS_RECORD_TYPE_DATA)
+			if (control && control != TLS_RECORD_TYPE_DATA)
 				goto recv_end;
 		} else {
 			break;
@@ -1961,8 +1982,22 @@ int tls_sw_recvmsg(struct sock *sk,
 		 */
 		WRITE_ONCE(ctx->async_notify, false);
 
-		/* Drain records from the rx_list & copy if required */
-		if (is_peek || is_kvec)
+		/* Drain records from the rx_list & copy if required. The
+		 * tls1.3 records from the first async one on were never
+		 * decrypted into the user buffer, and 'decrypted' only bounds
+		 * their length since the padding is stripped on completion,
+		 * so count what actually got copied. Records decrypted
+		 * synchronously before that are already in msg; when peeking
+		 * they also sit in rx_list and must be skipped.
+		 */
+		if (prot->version == TLS_1_3_VERSION) {
+			err = process_rx_list(ctx, msg, &control, &cmsg,
+					      is_peek ? copied + decrypted_sync : 0,
+					      decrypted - decrypted_sync,
+					      false, is_peek);
+			if (err >= 0)
+				decrypted = decrypted_sync + err;
+		} else if (is_peek || is_kvec)
 			err = process_rx_list(ctx, msg, &control, &cmsg, copied,
 					      decrypted, false, is_peek);
 		else
@@ -2003,36 +2038,81 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 
 	timeo = sock_rcvtimeo(sk, flags & SPLICE_F_NONBLOCK);
 
-	skb = tls_wait_data(sk, NULL, flags & SPLICE_F_NONBLOCK, timeo, &err);
-	if (!skb)
-		goto splice_read_end;
+	/* Keep splicing whole records while the pipe has room. The records
+	 * are decrypted in place, so their pages go into the pipe as they are
+	 * and never get copied through a bounce buffer.
+	 */
+	while (len) {
+		bool from_list = false;
+		u8 control;
+		int n;
+
+		/* Records left over from an async recvmsg() come first */
+		skb = skb_peek(&ctx->rx_list);
+		if (skb) {
+			from_list = true;
+			control = tls_msg(skb)->control;
+		} else {
+			skb = tls_wait_data(sk, NULL,
+					    (flags & SPLICE_F_NONBLOCK) || copied,
+					    timeo, &err);
+			if (!skb)
+				break;
 
-	if (!ctx->decrypted) {
-		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc, false);
+			if (!ctx->decrypted) {
+				err = decrypt_skb_update(sk, skb, NULL, &chunk,
+							 &zc, false);
+
+				/* splice does not support reading control
+				 * messages
+				 */
+				if (ctx->control != TLS_RECORD_TYPE_DATA) {
+					err = -EINVAL;
+					break;
+				}
+
+				if (err < 0) {
+					tls_err_abort(sk, -EBADMSG);
+					break;
+				}
+				ctx->decrypted = true;
+			}
+			control = ctx->control;
+		}
 
-		/* splice does not support reading control messages */
-		if (ctx->control != TLS_RECORD_TYPE_DATA) {
+		if (control != TLS_RECORD_TYPE_DATA) {
 			err = -EINVAL;
-			goto splice_read_end;
+			break;
 		}
 
-		if (err < 0) {
-			tls_err_abort(sk, -EBADMSG);
-			goto splice_read_end;
+		rxm = strp_msg(skb);
+		chunk = min_t(unsigned int, rxm->full_len, len);
+		n = skb_splice_bits(skb, sk, rxm->offset, pipe, chunk, flags);
+		if (n <= 0) {
+			if (n < 0)
+				err = n;
+			break;
 		}
-		ctx->decrypted = true;
-	}
-	rxm = strp_msg(skb);
 
-	chunk = min_t(unsigned int, rxm->full_len, len);
-	copied = skb_splice_bits(skb, sk, rxm->offset, pipe, chunk, flags);
-	if (copied < 0)
-		goto splice_read_end;
+		copied += n;
+		len -= n;
+
+		if (from_list) {
+			rxm->offset += n;
+			rxm->full_len -= n;
+			if (!rxm->full_len) {
+				skb_unlink(skb, &ctx->rx_list);
+				consume_skb(skb);
+			}
+		} else {
+			tls_sw_advance_skb(sk, skb, n);
+		}
 
-	if (likely(!(flags & MSG_PEEK)))
-		tls_sw_advance_skb(sk, skb, copied);
+		/* The pipe is full */
+		if (n < chunk)
+			break;
+	}
 
-splice_read_end:
 	release_sock(sk);
 	return copied ? : err;
 }
@@ -2493,11 +2573,8 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 	if (sw_ctx_rx) {
 		tfm = crypto_aead_tfm(sw_ctx_rx->aead_recv);
 
-		if (crypto_info->version == TLS_1_3_VERSION)
-			sw_ctx_rx->async_capable = false;
-		else
-			sw_ctx_rx->async_capable =
-				tfm->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC;
+		sw_ctx_rx->async_capable =
+			tfm->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC;
 
 		/* Set up strparser */
 		memset(&cb, 0, sizeof(cb));
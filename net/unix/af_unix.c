@@ -2926,6 +2926,15 @@ static int __net_init unix_net_init(struct net *net)
 		unix_sysctl_unregister(net);
 		goto out;
 	}
+
+	/* The garbage collector is shared by all namespaces */
+	if (net_eq(net, &init_net) &&
+	    !proc_create_net_single("unix_gc", 0444, net->proc_net,
+				    unix_gc_stats_show, NULL)) {
+		remove_proc_entry("unix", net->proc_net);
+		unix_sysctl_unregister(net);
+		goto out;
+	}
 #endif
 	error = 0;
 out:
@@ -2935,6 +2944,8 @@ static int __net_init unix_net_init(struct net *net)
 static void __net_exit unix_net_exit(struct net *net)
 {
 	unix_sysctl_unregister(net);
+	if (net_eq(net, &init_net))
+		remove_proc_entry("unix_gc", net->proc_net);
 	remove_proc_entry("unix", net->proc_net);
 }
 
@@ -2966,6 +2977,7 @@ static void __exit af_unix_exit(void)
 	sock_unregister(PF_UNIX);
 	proto_unregister(&unix_proto);
 	unregister_pernet_subsys(&unix_net_ops);
+	unix_gc_flush();
 }
 
 /* Earlier than device_initcall() so that other drivers invoking
@@ -75,6 +75,9 @@
 #include <linux/proc_fs.h>
 #include <linux/mutex.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
 
 #include <net/sock.h>
 #include <net/af_unix.h>
@@ -86,7 +89,6 @@
 /* Internal data structures and random procedures: */
 
 static LIST_HEAD(gc_candidates);
-static DECLARE_WAIT_QUEUE_HEAD(unix_gc_wait);
 
 static void scan_inflight(struct sock *x, void (*func)(struct unix_sock *),
 			  struct sk_buff_head *hitlist)
@@ -185,24 +187,75 @@ static void inc_inflight_move_tail(struct unix_sock *u)
 		list_move_tail(&u->link, &gc_candidates);
 }
 
+static void pull_unvisited(struct unix_sock *u)
+{
+	/* Held by a candidate of this collection, so it could be part of
+	 * the same garbage.  Queue it up to be scanned in turn.
+	 */
+	if (__test_and_clear_bit(UNIX_GC_UNVISITED, &u->gc_flags))
+		list_move_tail(&u->link, &gc_candidates);
+}
+
 static bool gc_in_progress;
 #define UNIX_INFLIGHT_TRIGGER_GC 16000
+#define UNIX_INFLIGHT_SANE_USER (SCM_MAX_FD * 8)
+
+/* Protected by unix_gc_lock */
+static struct {
+	unsigned long runs;
+	unsigned long skipped;
+	unsigned long scanned;
+	unsigned long collected;
+	u64 last_ns;
+	u64 max_ns;
+	u64 total_ns;
+} gc_stats;
+
+static void __unix_gc(struct work_struct *work);
+static DECLARE_WORK(unix_gc_work, __unix_gc);
 
 void wait_for_unix_gc(void)
 {
+	struct user_struct *user = current_user();
+
 	/* If number of inflight sockets is insane,
-	 * force a garbage collect right now.
+	 * kick a garbage collect right now.
 	 * Paired with the WRITE_ONCE() in unix_inflight(),
 	 * unix_notinflight() and gc_in_progress().
 	 */
 	if (READ_ONCE(unix_tot_inflight) > UNIX_INFLIGHT_TRIGGER_GC &&
 	    !READ_ONCE(gc_in_progress))
 		unix_gc();
-	wait_event(unix_gc_wait, gc_in_progress == false);
+
+	/* The collection runs asynchronously, only make the users that
+	 * keep piling up descriptors in flight wait for it.
+	 */
+	if (READ_ONCE(user->unix_inflight) < UNIX_INFLIGHT_SANE_USER)
+		return;
+
+	if (READ_ONCE(gc_in_progress))
+		flush_work(&unix_gc_work);
 }
 
 /* The external entry point: unix_gc() */
 void unix_gc(void)
+{
+	/* unix_gc_lock orders this against the end of a running pass,
+	 * which only clears gc_in_progress if no other pass is queued.
+	 */
+	spin_lock(&unix_gc_lock);
+	/* Paired with READ_ONCE() in wait_for_unix_gc(). */
+	WRITE_ONCE(gc_in_progress, true);
+	queue_work(system_unbound_wq, &unix_gc_work);
+	spin_unlock(&unix_gc_lock);
+}
+
+void unix_gc_flush(void)
+{
+	flush_work(&unix_gc_work);
+}
+
+static void __unix_gc(struct work_struct *work)
 {
 	struct sk_buff *next_skb, *skb;
 	struct unix_sock *u;
@@ -210,16 +263,13 @@ void unix_gc(void)
 	struct sk_buff_head hitlist;
 	struct list_head cursor;
 	LIST_HEAD(not_cycle_list);
+	LIST_HEAD(unvisited);
+	unsigned long scanned = 0, collected = 0;
+	ktime_t start = ktime_get();
+	u64 delta;
 
 	spin_lock(&unix_gc_lock);
 
-	/* Avoid a recursive GC. */
-	if (gc_in_progress)
-		goto out;
-
-	/* Paired with READ_ONCE() in wait_for_unix_gc(). */
-	WRITE_ONCE(gc_in_progress, true);
-
 	/* First, select candidates for garbage collection.  Only
 	 * in-flight sockets are considered, and from those only ones
 	 * which don't have any external reference.
@@ -234,10 +284,17 @@ void unix_gc(void)
 	 * receive queues.  Other, non candidate sockets _can_ be
 	 * added to queue, so we must make sure only to touch
 	 * candidates.
+	 *
+	 * The previous collection left no garbage behind, so new
+	 * garbage must contain a candidate which changed since then:
+	 * one whose in-flight count moved, or which just lost its last
+	 * external reference.  Only those are selected right away, the
+	 * unchanged ones are set aside.
 	 */
 	list_for_each_entry_safe(u, next, &gc_inflight_list, link) {
 		long total_refs;
 		long inflight_refs;
+		bool changed;
 
 		total_refs = file_count(u->sk.sk_socket->file);
 		inflight_refs = atomic_long_read(&u->inflight);
@@ -245,17 +302,55 @@ void unix_gc(void)
 		BUG_ON(inflight_refs < 1);
 		BUG_ON(total_refs < inflight_refs);
 		if (total_refs == inflight_refs) {
-			list_move_tail(&u->link, &gc_candidates);
 			__set_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
 			__set_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
+
+			changed = __test_and_clear_bit(UNIX_GC_DIRTY,
+						       &u->gc_flags);
+			if (!__test_and_set_bit(UNIX_GC_SEEN, &u->gc_flags))
+				changed = true;
+
+			if (changed) {
+				list_move_tail(&u->link, &gc_candidates);
+			} else {
+				__set_bit(UNIX_GC_UNVISITED, &u->gc_flags);
+				list_move_tail(&u->link, &unvisited);
+			}
+		} else {
+			__clear_bit(UNIX_GC_DIRTY, &u->gc_flags);
+			__clear_bit(UNIX_GC_SEEN, &u->gc_flags);
 		}
 	}
 
+	/* Pull in the unchanged candidates reachable from the changed
+	 * ones, transitively.  Whatever is left was reachable at the end
+	 * of the last collection and nothing on the way to it changed,
+	 * so it still is: drop it from the candidates, which makes it
+	 * count as an external reference to its children.
+	 */
+	list_for_each_entry(u, &gc_candidates, link)
+		scan_children(&u->sk, pull_unvisited, NULL);
+
+	while (!list_empty(&unvisited)) {
+		u = list_entry(unvisited.next, struct unix_sock, link);
+		__clear_bit(UNIX_GC_UNVISITED, &u->gc_flags);
+		__clear_bit(UNIX_GC_MAYBE_CYCLE, &u->gc_flags);
+		__clear_bit(UNIX_GC_CANDIDATE, &u->gc_flags);
+		list_move_tail(&u->link, &gc_inflight_list);
+	}
+
+	if (list_empty(&gc_candidates)) {
+		gc_stats.skipped++;
+		goto out;
+	}
+
 	/* Now remove all internal in-flight reference to children of
 	 * the candidates.
 	 */
-	list_for_each_entry(u, &gc_candidates, link)
+	list_for_each_entry(u, &gc_candidates, link) {
 		scan_children(&u->sk, dec_inflight, NULL);
+		scanned++;
+	}
 
 	/* Restore the references for children of all candidates,
 	 * which have remaining references.  Do this recursively, so
@@ -284,8 +379,10 @@ void unix_gc(void)
 	 * which are creating the cycle(s).
 	 */
 	skb_queue_head_init(&hitlist);
-	list_for_each_entry(u, &gc_candidates, link)
+	list_for_each_entry(u, &gc_candidates, link) {
 		scan_children(&u->sk, inc_inflight, &hitlist);
+		collected++;
+	}
 
 	/* not_cycle_list contains those sockets which do not make up a
 	 * cycle.  Restore these to the inflight list.
@@ -325,11 +422,38 @@ void unix_gc(void)
 	/* All candidates should have been detached by now. */
 	BUG_ON(!list_empty(&gc_candidates));
 
-	/* Paired with READ_ONCE() in wait_for_unix_gc(). */
-	WRITE_ONCE(gc_in_progress, false);
+ out:
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	gc_stats.runs++;
+	gc_stats.scanned += scanned;
+	gc_stats.collected += collected;
+	gc_stats.last_ns = delta;
+	gc_stats.max_ns = max(gc_stats.max_ns, delta);
+	gc_stats.total_ns += delta;
+
+	/* A pass requested while this one ran has been queued again and
+	 * is still to come.  Paired with READ_ONCE() in wait_for_unix_gc().
+	 */
+	if (!work_pending(&unix_gc_work))
+		WRITE_ONCE(gc_in_progress, false);
 
-	wake_up(&unix_gc_wait);
+	spin_unlock(&unix_gc_lock);
+}
 
- out:
+#ifdef CONFIG_PROC_FS
+int unix_gc_stats_show(struct seq_file *seq, void *v)
+{
+	spin_lock(&unix_gc_lock);
+	seq_printf(seq, "inflight: %u\n", unix_tot_inflight);
+	seq_printf(seq, "runs: %lu\n", gc_stats.runs);
+	seq_printf(seq, "skipped: %lu\n", gc_stats.skipped);
+	seq_printf(seq, "scanned: %lu\n", gc_stats.scanned);
+	seq_printf(seq, "collected: %lu\n", gc_stats.collected);
+	seq_printf(seq, "last_ns: %llu\n", gc_stats.last_ns);
+	seq_printf(seq, "max_ns: %llu\n", gc_stats.max_ns);
+	seq_printf(seq, "total_ns: %llu\n", gc_stats.total_ns);
 	spin_unlock(&unix_gc_lock);
+
+	return 0;
 }
+#endif
@@ -59,6 +59,7 @@ void unix_inflight(struct user_struct *user, struct file *fp)
 		} else {
 			BUG_ON(list_empty(&u->link));
 		}
+		__set_bit(UNIX_GC_DIRTY, &u->gc_flags);
 		/* Paired with READ_ONCE() in wait_for_unix_gc() */
 		WRITE_ONCE(unix_tot_inflight, unix_tot_inflight + 1);
 	}
@@ -78,8 +79,13 @@ void unix_notinflight(struct user_struct *user, struct file *fp)
 		BUG_ON(!atomic_long_read(&u->inflight));
 		BUG_ON(list_empty(&u->link));
 
-		if (atomic_long_dec_and_test(&u->inflight))
+		if (atomic_long_dec_and_test(&u->inflight)) {
 			list_del_init(&u->link);
+			__clear_bit(UNIX_GC_DIRTY, &u->gc_flags);
+			__clear_bit(UNIX_GC_SEEN, &u->gc_flags);
+		} else {
+			__set_bit(UNIX_GC_DIRTY, &u->gc_flags);
+		}
 		/* Paired with READ_ONCE() in wait_for_unix_gc() */
 		WRITE_ONCE(unix_tot_inflight, unix_tot_inflight - 1);
 	}
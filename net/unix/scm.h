@@ -4,6 +4,24 @@
 extern struct list_head gc_inflight_list;
 extern spinlock_t unix_gc_lock;
 
+/* Private gc_flags bits of the collector, following UNIX_GC_CANDIDATE and
+ * UNIX_GC_MAYBE_CYCLE.  All of them are protected by unix_gc_lock.
+ *
+ * UNIX_GC_DIRTY:	the in-flight count changed since the last collection
+ * UNIX_GC_SEEN:	was already a candidate in the last collection
+ * UNIX_GC_UNVISITED:	candidate not (yet) reachable from a changed one
+ */
+#define UNIX_GC_DIRTY		2
+#define UNIX_GC_SEEN		3
+#define UNIX_GC_UNVISITED	4
+
+void unix_gc_flush(void);
+
+#ifdef CONFIG_PROC_FS
+struct seq_file;
+int unix_gc_stats_show(struct seq_file *seq, void *v);
+#endif
+
 int unix_attach_fds(struct scm_cookie *scm, struct sk_buff *skb);
 void unix_detach_fds(struct scm_cookie *scm, struct sk_buff *skb);
 
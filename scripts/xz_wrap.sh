@@ -18,6 +18,11 @@ case $SRCARCH in
 	ia64)           BCJ=--ia64; LZMA2OPTS=pb=4 ;;
 	arm)            BCJ=--arm ;;
 	sparc)          BCJ=--sparc ;;
+	arm64)
+		# The ARM64 filter needs XZ Utils 5.4 or later.
+		if $XZ --long-help 2>/dev/null | grep -q -e --arm64; then
+			BCJ=--arm64
+		fi ;;
 esac
 
 exec $XZ --check=crc32 $BCJ --lzma2=$LZMA2OPTS,dict=32MiB
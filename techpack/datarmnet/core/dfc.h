@@ -292,6 +292,31 @@ TRACE_EVENT(dfc_adjust_grant,
 		__entry->rx_bytes, __entry->inflight, __entry->a_grant)
 );
 
+TRACE_EVENT(dfc_credit_stall,
+
+	TP_PROTO(u8 mux_id, u8 bearer_id, unsigned int len, u32 grant),
+
+	TP_ARGS(mux_id, bearer_id, len, grant),
+
+	TP_STRUCT__entry(
+		__field(u8, mux_id)
+		__field(u8, bearer_id)
+		__field(unsigned int, len)
+		__field(u32, grant)
+	),
+
+	TP_fast_assign(
+		__entry->mux_id = mux_id;
+		__entry->bearer_id = bearer_id;
+		__entry->len = len;
+		__entry->grant = grant;
+	),
+
+	TP_printk("mid=%u bid=%u skb_len=%u last_grant=%u",
+		__entry->mux_id, __entry->bearer_id, __entry->len,
+		__entry->grant)
+);
+
 TRACE_EVENT(dfc_watchdog,
 
 	TP_PROTO(u8 mux_id, u8 bearer_id, u8 event),
@@ -952,6 +952,7 @@ static int dfc_all_bearer_flow_ctl(struct net_device *dev,
 	struct rmnet_bearer_map *bearer;
 
 	list_for_each_entry(bearer, &qos->bearer_head, list) {
+		qmi_rmnet_bearer_drain_credit(bearer);
 		bearer->grant_size = fc_info->num_bytes;
 		bearer->grant_thresh =
 			qmi_rmnet_grant_per(bearer->grant_size);
@@ -1010,6 +1011,8 @@ static int dfc_update_fc_map(struct net_device *dev, struct qos_info *qos,
 		itm = qmi_rmnet_get_bearer_noref(qos, fc_info->bearer_id);
 
 	if (itm) {
+		qmi_rmnet_bearer_drain_credit(itm);
+
 		/* The RAT switch flag indicates the start and end of
 		 * the switch. Ignore indications in between.
 		 */
@@ -1156,6 +1159,8 @@ static void dfc_update_tx_link_status(struct net_device *dev,
 	if (itm->tx_off == !tx_status)
 		return;
 
+	qmi_rmnet_bearer_drain_credit(itm);
+
 	if (itm->grant_size && !tx_status) {
 		itm->grant_size = 0;
 		itm->tcp_bidir = false;
@@ -1495,6 +1500,19 @@ void dfc_qmi_burst_check(struct net_device *dev, struct qos_info *qos,
 	struct rmnet_flow_map *itm;
 	u32 start_grant;
 
+	/* Fast path: charge the packet to this CPU's credit cache */
+	rcu_read_lock();
+	itm = qmi_rmnet_get_flow_map(qos, mark, ip_type);
+	if (likely(itm))
+		bearer = READ_ONCE(itm->bearer);
+
+	if (likely(bearer) && qmi_rmnet_bearer_take_credit(bearer, len)) {
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	bearer = NULL;
 	spin_lock_bh(&qos->qos_lock);
 
 	/* Mark is flow_id */
@@ -1513,6 +1531,10 @@ void dfc_qmi_burst_check(struct net_device *dev, struct qos_info *qos,
 	if (!bearer->grant_size)
 		goto out;
 
+	/* Pull back credit cached on other CPUs before running dry */
+	if (len >= bearer->grant_size)
+		qmi_rmnet_bearer_drain_credit(bearer);
+
 	start_grant = bearer->grant_size;
 	if (len >= bearer->grant_size)
 		bearer->grant_size = 0;
@@ -1526,8 +1548,13 @@ void dfc_qmi_burst_check(struct net_device *dev, struct qos_info *qos,
 			     DFC_ACK_TYPE_THRESHOLD);
 	}
 
-	if (!bearer->grant_size)
+	if (!bearer->grant_size) {
+		trace_dfc_credit_stall(qos->mux_id, bearer->bearer_id, len,
+				       start_grant);
 		dfc_bearer_flow_ctl(dev, bearer, qos);
+	} else {
+		qmi_rmnet_bearer_refill_credit(bearer);
+	}
 
 out:
 	spin_unlock_bh(&qos->qos_lock);
@@ -140,6 +140,18 @@ qmi_rmnet_has_pending(struct qmi_info *qmi)
 }
 
 #ifdef CONFIG_QTI_QMI_DFC
+static void qmi_rmnet_bearer_free(struct rmnet_bearer_map *bearer)
+{
+	free_percpu(bearer->credit);
+	kfree(bearer);
+}
+
+static void qmi_rmnet_bearer_free_rcu(struct rcu_head *head)
+{
+	qmi_rmnet_bearer_free(container_of(head, struct rmnet_bearer_map,
+					   rcu));
+}
+
 static void
 qmi_rmnet_clean_flow_list(struct qos_info *qos)
 {
@@ -155,12 +167,13 @@ qmi_rmnet_clean_flow_list(struct qos_info *qos)
 
 	list_for_each_entry_safe(bearer, br_tmp, &qos->bearer_head, list) {
 		list_del(&bearer->list);
-		kfree(bearer);
+		qmi_rmnet_bearer_free(bearer);
 	}
 
 	memset(qos->mq, 0, sizeof(qos->mq));
 }
 
+/* Needs to be called with qos_lock or rcu_read_lock */
 struct rmnet_flow_map *
 qmi_rmnet_get_flow_map(struct qos_info *qos, u32 flow_id, int ip_type)
 {
@@ -169,7 +182,7 @@ qmi_rmnet_get_flow_map(struct qos_info *qos, u32 flow_id, int ip_type)
 	if (!qos)
 		return NULL;
 
-	list_for_each_entry(itm, &qos->flow_head, list) {
+	list_for_each_entry_rcu(itm, &qos->flow_head, list) {
 		if ((itm->flow_id == flow_id) && (itm->ip_type == ip_type))
 			return itm;
 	}
@@ -242,6 +255,7 @@ static void qmi_rmnet_watchdog_fn(struct timer_list *t)
 	 * the bearer if disabled.
 	 */
 	bearer->watchdog_expire_cnt++;
+	qmi_rmnet_bearer_drain_credit(bearer);
 	bearer->bytes_in_flight = 0;
 	if (!bearer->grant_size) {
 		bearer->grant_size = DEFAULT_CALL_GRANT;
@@ -290,6 +304,71 @@ void qmi_rmnet_watchdog_remove(struct rmnet_bearer_map *bearer)
 	trace_dfc_watchdog(bearer->qos->mux_id, bearer->bearer_id, 0);
 }
 
+/**
+ * qmi_rmnet_bearer_take_credit - charge a packet to the local credit cache
+ * Lockless, called from the TX path with BH disabled. Returns false if
+ * this CPU does not have enough credit cached for the packet.
+ */
+bool qmi_rmnet_bearer_take_credit(struct rmnet_bearer_map *bearer,
+				  unsigned int len)
+{
+	atomic_t *credit;
+	int old;
+
+	if (!bearer->credit)
+		return false;
+
+	credit = this_cpu_ptr(bearer->credit);
+	do {
+		old = atomic_read(credit);
+		if (old < len)
+			return false;
+	} while (atomic_cmpxchg(credit, old, old - len) != old);
+
+	return true;
+}
+
+/**
+ * qmi_rmnet_bearer_refill_credit - move a batch of grant to this CPU
+ * Needs to be called with qos_lock
+ *
+ * Credit is only handed out while the grant stays above the threshold, so
+ * threshold acks and flow disable are always decided on the locked path.
+ * Cached bytes are accounted as in flight until they are drained.
+ */
+void qmi_rmnet_bearer_refill_credit(struct rmnet_bearer_map *bearer)
+{
+	if (!bearer->credit ||
+	    bearer->grant_size < bearer->grant_thresh + DFC_CREDIT_BATCH)
+		return;
+
+	bearer->grant_size -= DFC_CREDIT_BATCH;
+	bearer->bytes_in_flight += DFC_CREDIT_BATCH;
+	atomic_add(DFC_CREDIT_BATCH, this_cpu_ptr(bearer->credit));
+}
+
+/**
+ * qmi_rmnet_bearer_drain_credit - return cached credit to the bearer
+ * Needs to be called with qos_lock
+ */
+void qmi_rmnet_bearer_drain_credit(struct rmnet_bearer_map *bearer)
+{
+	u32 left;
+	int cpu;
+
+	if (!bearer->credit)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		left = atomic_xchg(per_cpu_ptr(bearer->credit, cpu), 0);
+		if (!left)
+			continue;
+
+		bearer->grant_size += left;
+		bearer->bytes_in_flight -= min(left, bearer->bytes_in_flight);
+	}
+}
+
 /**
  * qmi_rmnet_bearer_clean - clean the removed bearer
  * Needs to be called with rtn_lock but not qos_lock
@@ -299,7 +378,8 @@ static void qmi_rmnet_bearer_clean(struct qos_info *qos)
 	if (qos->removed_bearer) {
 		qos->removed_bearer->watchdog_quit = true;
 		del_timer_sync(&qos->removed_bearer->watchdog);
-		kfree(qos->removed_bearer);
+		/* Lockless TX path may still be looking at the bearer */
+		call_rcu(&qos->removed_bearer->rcu, qmi_rmnet_bearer_free_rcu);
 		qos->removed_bearer = NULL;
 	}
 }
@@ -317,6 +397,8 @@ static struct rmnet_bearer_map *__qmi_rmnet_bearer_get(
 		if (!bearer)
 			return NULL;
 
+		/* The bearer still works without the credit cache */
+		bearer->credit = alloc_percpu_gfp(atomic_t, GFP_ATOMIC);
 		bearer->bearer_id = bearer_id;
 		bearer->flow_ref = 1;
 		bearer->grant_size = DEFAULT_CALL_GRANT;
@@ -412,7 +494,7 @@ static int __qmi_rmnet_rebind_flow(struct net_device *dev,
 		return -ENOMEM;
 
 	qmi_rmnet_update_flow_map(itm, new_map);
-	itm->bearer = bearer;
+	WRITE_ONCE(itm->bearer, bearer);
 
 	__qmi_rmnet_update_mq(dev, qos_info, bearer, itm);
 
@@ -476,7 +558,7 @@ static int qmi_rmnet_add_flow(struct net_device *dev, struct tcmsg *tcm,
 	}
 
 	qmi_rmnet_update_flow_map(itm, &new_map);
-	list_add(&itm->list, &qos_info->flow_head);
+	list_add_rcu(&itm->list, &qos_info->flow_head);
 
 	/* Create or update bearer map */
 	bearer = __qmi_rmnet_bearer_get(qos_info, new_map.bearer_id);
@@ -485,7 +567,7 @@ static int qmi_rmnet_add_flow(struct net_device *dev, struct tcmsg *tcm,
 		goto done;
 	}
 
-	itm->bearer = bearer;
+	WRITE_ONCE(itm->bearer, bearer);
 
 	__qmi_rmnet_update_mq(dev, qos_info, bearer, itm);
 
@@ -529,8 +611,8 @@ qmi_rmnet_del_flow(struct net_device *dev, struct tcmsg *tcm,
 		__qmi_rmnet_bearer_put(dev, qos_info, itm->bearer, true);
 
 		/* Remove from flow map */
-		list_del(&itm->list);
-		kfree(itm);
+		list_del_rcu(&itm->list);
+		kfree_rcu(itm, rcu);
 	}
 
 	if (list_empty(&qos_info->flow_head))
@@ -809,6 +891,7 @@ void qmi_rmnet_enable_all_flows(struct net_device *dev)
 	spin_lock_bh(&qos->qos_lock);
 
 	list_for_each_entry(bearer, &qos->bearer_head, list) {
+		qmi_rmnet_bearer_drain_credit(bearer);
 		bearer->seq = 0;
 		bearer->ack_req = 0;
 		bearer->bytes_in_flight = 0;
@@ -24,6 +24,7 @@
 #define MAX_FLOW_NUM 32
 #define DEFAULT_GRANT 1
 #define DEFAULT_CALL_GRANT 20480
+#define DFC_CREDIT_BATCH 16384
 #define DFC_MAX_BEARERS_V01 16
 #define DEFAULT_MQ_NUM 0
 #define ACK_MQ_OFFSET (MAX_MQ_NUM - 1)
@@ -42,6 +43,7 @@ struct qos_info;
 
 struct rmnet_bearer_map {
 	struct list_head list;
+	struct rcu_head rcu;
 	u8 bearer_id;
 	int flow_ref;
 	u32 grant_size;
@@ -63,10 +65,13 @@ struct rmnet_bearer_map {
 	bool watchdog_started;
 	bool watchdog_quit;
 	u32 watchdog_expire_cnt;
+	/* Per-CPU grant bytes taken out of grant_size in batches */
+	atomic_t __percpu *credit;
 };
 
 struct rmnet_flow_map {
 	struct list_head list;
+	struct rcu_head rcu;
 	u8 bearer_id;
 	u32 flow_id;
 	int ip_type;
@@ -171,6 +176,13 @@ void qmi_rmnet_watchdog_add(struct rmnet_bearer_map *bearer);
 
 void qmi_rmnet_watchdog_remove(struct rmnet_bearer_map *bearer);
 
+bool qmi_rmnet_bearer_take_credit(struct rmnet_bearer_map *bearer,
+				  unsigned int len);
+
+void qmi_rmnet_bearer_refill_credit(struct rmnet_bearer_map *bearer);
+
+void qmi_rmnet_bearer_drain_credit(struct rmnet_bearer_map *bearer);
+
 #else
 static inline struct rmnet_flow_map *
 qmi_rmnet_get_flow_map(struct qos_info *qos_info,
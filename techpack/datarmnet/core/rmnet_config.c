@@ -131,28 +131,42 @@ static int rmnet_register_real_device(struct net_device *real_dev)
 	port->phy_shs_cfg.map_mask = QMAP_SHS_MASK;
 	port->phy_shs_cfg.max_pkts = QMAP_SHS_PKT_LIMIT;
 
+	for (entry = 0; entry < RMNET_MAX_LOGICAL_EP; entry++)
+		INIT_HLIST_HEAD(&port->muxed_ep[entry]);
+
+	/* The rx handler makes the port visible, so the aggregation
+	 * contexts must exist before it is registered.
+	 */
+	rc = rmnet_map_tx_aggregate_init(port);
+	if (rc)
+		goto err_free_port;
+
 	rc = netdev_rx_handler_register(real_dev, rmnet_rx_handler, port);
 	if (rc) {
-		kfree(port);
-		return -EBUSY;
+		rc = -EBUSY;
+		goto err_agg_exit;
 	}
 	/* hold on to real dev for MAP data */
 	dev_hold(real_dev);
 
-	for (entry = 0; entry < RMNET_MAX_LOGICAL_EP; entry++)
-		INIT_HLIST_HEAD(&port->muxed_ep[entry]);
-
 	rc = rmnet_descriptor_init(port);
-	if (rc) {
-		rmnet_descriptor_deinit(port);
-		return rc;
-	}
+	if (rc)
+		goto err_unregister;
 
-	rmnet_map_tx_aggregate_init(port);
 	rmnet_map_cmd_init(port);
 
 	netdev_dbg(real_dev, "registered with rmnet\n");
 	return 0;
+
+err_unregister:
+	rmnet_descriptor_deinit(port);
+	netdev_rx_handler_unregister(real_dev);
+	dev_put(real_dev);
+err_agg_exit:
+	rmnet_map_tx_aggregate_exit(port);
+err_free_port:
+	kfree(port);
+	return rc;
 }
 
 static void rmnet_unregister_bridge(struct net_device *dev,
@@ -232,8 +246,10 @@ static int rmnet_newlink(struct net *src_net, struct net_device *dev,
 
 		agg_params = nla_data(data[IFLA_RMNET_UL_AGG_PARAMS]);
 		spin_lock_irqsave(&port->agg_lock, irq_flags);
+		write_seqcount_begin(&port->agg_params_seq);
 		memcpy(&port->egress_agg_params, agg_params,
 		       sizeof(port->egress_agg_params));
+		write_seqcount_end(&port->agg_params_seq);
 		spin_unlock_irqrestore(&port->agg_lock, irq_flags);
 	}
 
@@ -44,6 +44,7 @@ struct rmnet_endpoint {
 struct rmnet_agg_stats {
 	u64 ul_agg_reuse;
 	u64 ul_agg_alloc;
+	u64 ul_agg_frag;
 };
 
 struct rmnet_port_priv_stats {
@@ -74,6 +75,27 @@ struct rmnet_agg_page {
 	struct page *page;
 };
 
+/* Uplink aggregation state. One instance exists per CPU for every port. */
+struct rmnet_agg_ctx {
+	struct rmnet_port *port;
+
+	/* Protect aggregation related elements */
+	spinlock_t agg_lock;
+
+	struct sk_buff *agg_skb;
+	int agg_state;
+	u8 agg_count;
+	/* Bytes of the aggregation page used for copied data */
+	u32 agg_copy_off;
+	/* Port egress_agg_params, read once per packet */
+	struct rmnet_egress_agg_params params;
+	/* Packets attached as fragments, folded into stats.agg.ul_agg_frag */
+	u64 ul_agg_frag;
+	struct timespec64 agg_time;
+	struct timespec64 agg_last;
+	struct hrtimer hrtimer;
+	struct work_struct agg_wq;
+};
 
 /* One instance of this structure is instantiated for each real_dev associated
  * with rmnet.
@@ -88,17 +110,13 @@ struct rmnet_port {
 	void *rmnet_perf;
 
 	struct rmnet_egress_agg_params egress_agg_params;
+	/* Lets aggregation contexts read egress_agg_params without agg_lock */
+	seqcount_t agg_params_seq;
 
-	/* Protect aggregation related elements */
+	/* Protect aggregation config and page pool */
 	spinlock_t agg_lock;
 
-	struct sk_buff *agg_skb;
-	int agg_state;
-	u8 agg_count;
-	struct timespec64 agg_time;
-	struct timespec64 agg_last;
-	struct hrtimer hrtimer;
-	struct work_struct agg_wq;
+	struct rmnet_agg_ctx __percpu *agg_ctx;
 	u8 agg_size_order;
 	struct list_head agg_list;
 	struct rmnet_agg_page *agg_head;
@@ -175,6 +193,7 @@ struct rmnet_priv_stats {
 	u64 csum_hw;
 	struct rmnet_coal_stats coal;
 	u64 ul_prio;
+	u64 sw_coal_pkts;
 };
 
 struct rmnet_priv {
@@ -1628,13 +1628,217 @@ int rmnet_frag_process_next_hdr_packet(struct rmnet_frag_descriptor *frag_desc,
 	return rc;
 }
 
+/* Software coalescing of in-order TCP segments that the hardware delivered
+ * one by one. Consecutive segments of the same flow are merged into a single
+ * descriptor which is handed to the stack as a GSO packet.
+ */
+#define RMNET_SW_COAL_MAX_SEGS 64
+#define RMNET_SW_COAL_MAX_LEN 0xFFFF
+#define RMNET_SW_COAL_HDR_MAX (sizeof(struct ipv6hdr) + 60)
+#define RMNET_SW_COAL_TCP_FLAGS (TCP_FLAG_CWR | TCP_FLAG_ECE | TCP_FLAG_URG | \
+				 TCP_FLAG_ACK | TCP_FLAG_PSH | TCP_FLAG_RST | \
+				 TCP_FLAG_SYN | TCP_FLAG_FIN)
+
+struct rmnet_frag_sw_coal {
+	struct rmnet_frag_descriptor *desc;
+	u32 next_seq;
+	u8 hdr[RMNET_SW_COAL_HDR_MAX];
+};
+
+/* Copy the IP and TCP headers of a packet into buf and fill in the header
+ * metadata of the descriptor. Returns 0 if the packet can be coalesced.
+ */
+static int rmnet_frag_sw_coal_hdrs(struct rmnet_frag_descriptor *frag_desc,
+				   u8 *buf)
+{
+	struct tcphdr *th;
+	u16 ip_len;
+	u8 version;
+
+	if (!frag_desc->csum_valid || frag_desc->hdrs_valid ||
+	    rmnet_frag_copy_data(frag_desc, 0, sizeof(version), &version) < 0)
+		return -EINVAL;
+
+	if ((version & 0xF0) == 0x40) {
+		struct iphdr *iph = (struct iphdr *)buf;
+
+		ip_len = sizeof(*iph);
+		if (rmnet_frag_copy_data(frag_desc, 0, ip_len, iph) < 0 ||
+		    iph->ihl != 5 || iph->protocol != IPPROTO_TCP ||
+		    ip_is_fragment(iph) || ntohs(iph->tot_len) != frag_desc->len)
+			return -EINVAL;
+
+		frag_desc->ip_proto = 4;
+	} else if ((version & 0xF0) == 0x60) {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)buf;
+
+		ip_len = sizeof(*ip6h);
+		if (rmnet_frag_copy_data(frag_desc, 0, ip_len, ip6h) < 0 ||
+		    ip6h->nexthdr != IPPROTO_TCP ||
+		    ntohs(ip6h->payload_len) + ip_len != frag_desc->len)
+			return -EINVAL;
+
+		frag_desc->ip_proto = 6;
+	} else {
+		return -EINVAL;
+	}
+
+	th = (struct tcphdr *)(buf + ip_len);
+	if (rmnet_frag_copy_data(frag_desc, ip_len, sizeof(*th), th) < 0 ||
+	    th->doff < 5 ||
+	    rmnet_frag_copy_data(frag_desc, ip_len, th->doff * 4, th) < 0)
+		return -EINVAL;
+
+	/* Only plain data segments are worth holding on to */
+	if ((tcp_flag_word(th) & RMNET_SW_COAL_TCP_FLAGS & ~TCP_FLAG_PSH) !=
+	    TCP_FLAG_ACK || frag_desc->len <= ip_len + th->doff * 4)
+		return -EINVAL;
+
+	frag_desc->ip_len = ip_len;
+	frag_desc->trans_len = th->doff * 4;
+	frag_desc->trans_proto = IPPROTO_TCP;
+	return 0;
+}
+
+/* Check if a packet continues the flow held in the coalescing context */
+static bool rmnet_frag_sw_coal_match(struct rmnet_frag_sw_coal *coal,
+				     struct rmnet_frag_descriptor *frag_desc,
+				     u8 *hdr)
+{
+	struct rmnet_frag_descriptor *head = coal->desc;
+	u16 hlen = head->ip_len + head->trans_len;
+	struct tcphdr *th, *th2;
+
+	if (head->dev != frag_desc->dev ||
+	    head->ip_proto != frag_desc->ip_proto ||
+	    head->trans_len != frag_desc->trans_len)
+		return false;
+
+	if (head->gso_segs >= RMNET_SW_COAL_MAX_SEGS ||
+	    frag_desc->len - hlen > head->gso_size ||
+	    head->len + frag_desc->len - hlen > RMNET_SW_COAL_MAX_LEN)
+		return false;
+
+	if (head->ip_proto == 4) {
+		struct iphdr *iph = (struct iphdr *)coal->hdr;
+		struct iphdr *iph2 = (struct iphdr *)hdr;
+
+		if (iph->saddr != iph2->saddr || iph->daddr != iph2->daddr ||
+		    iph->tos != iph2->tos || iph->ttl != iph2->ttl ||
+		    iph->frag_off != iph2->frag_off)
+			return false;
+	} else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)coal->hdr;
+		struct ipv6hdr *ip6h2 = (struct ipv6hdr *)hdr;
+
+		if (ipv6_addr_cmp(&ip6h->saddr, &ip6h2->saddr) ||
+		    ipv6_addr_cmp(&ip6h->daddr, &ip6h2->daddr) ||
+		    ip6_flowinfo(ip6h) != ip6_flowinfo(ip6h2) ||
+		    ip6h->hop_limit != ip6h2->hop_limit)
+			return false;
+	}
+
+	th = (struct tcphdr *)(coal->hdr + head->ip_len);
+	th2 = (struct tcphdr *)(hdr + frag_desc->ip_len);
+	if (th->source != th2->source || th->dest != th2->dest ||
+	    th->ack_seq != th2->ack_seq || th->window != th2->window ||
+	    ntohl(th2->seq) != coal->next_seq)
+		return false;
+
+	/* Options such as timestamps must be identical */
+	return !memcmp(th + 1, th2 + 1, head->trans_len - sizeof(*th));
+}
+
+static void rmnet_frag_sw_coal_flush(struct rmnet_frag_sw_coal *coal,
+				     struct rmnet_port *port)
+{
+	struct rmnet_frag_descriptor *frag_desc = coal->desc;
+
+	if (!frag_desc)
+		return;
+
+	coal->desc = NULL;
+	if (frag_desc->gso_segs > 1) {
+		struct rmnet_priv *priv = netdev_priv(frag_desc->dev);
+
+		frag_desc->hdrs_valid = 1;
+		priv->stats.sw_coal_pkts++;
+	} else {
+		/* Nothing was merged, so deliver the packet untouched */
+		frag_desc->gso_size = 0;
+		frag_desc->gso_segs = 0;
+	}
+
+	rmnet_frag_deliver(frag_desc, port);
+}
+
+static void rmnet_frag_sw_coal_deliver(struct rmnet_frag_sw_coal *coal,
+				       struct rmnet_frag_descriptor *frag_desc,
+				       struct rmnet_port *port)
+{
+	struct rmnet_frag_descriptor *head = coal->desc;
+	u8 hdr[RMNET_SW_COAL_HDR_MAX];
+	u32 hlen, payload, len;
+	struct tcphdr *th;
+
+	if (rmnet_frag_sw_coal_hdrs(frag_desc, hdr)) {
+		rmnet_frag_sw_coal_flush(coal, port);
+		rmnet_frag_deliver(frag_desc, port);
+		return;
+	}
+
+	hlen = frag_desc->ip_len + frag_desc->trans_len;
+	payload = frag_desc->len - hlen;
+	th = (struct tcphdr *)(hdr + frag_desc->ip_len);
+
+	if (head && rmnet_frag_sw_coal_match(coal, frag_desc, hdr)) {
+		len = head->len;
+		if (rmnet_frag_descriptor_add_frags_from(head, frag_desc, hlen,
+							 payload) < 0) {
+			/* Undo the partial append and send both separately */
+			rmnet_frag_trim(head, port, len);
+			rmnet_frag_sw_coal_flush(coal, port);
+			rmnet_frag_deliver(frag_desc, port);
+			return;
+		}
+
+		head->gso_segs++;
+		coal->next_seq += payload;
+		if (th->psh) {
+			head->tcp_flags_set = 1;
+			head->tcp_flags = *(__be16 *)&tcp_flag_word(th);
+		}
+
+		rmnet_recycle_frag_descriptor(frag_desc, port);
+
+		/* A short or pushed segment ends the train */
+		if (th->psh || payload < head->gso_size)
+			rmnet_frag_sw_coal_flush(coal, port);
+
+		return;
+	}
+
+	rmnet_frag_sw_coal_flush(coal, port);
+	if (th->psh) {
+		rmnet_frag_deliver(frag_desc, port);
+		return;
+	}
+
+	frag_desc->gso_size = payload;
+	frag_desc->gso_segs = 1;
+	coal->desc = frag_desc;
+	coal->next_seq = ntohl(th->seq) + payload;
+	memcpy(coal->hdr, hdr, hlen);
+}
+
 /* Perf hook handler */
 rmnet_perf_desc_hook_t rmnet_perf_desc_entry __rcu __read_mostly;
 EXPORT_SYMBOL(rmnet_perf_desc_entry);
 
 static void
 __rmnet_frag_ingress_handler(struct rmnet_frag_descriptor *frag_desc,
-			     struct rmnet_port *port)
+			     struct rmnet_port *port,
+			     struct rmnet_frag_sw_coal *coal)
 {
 	rmnet_perf_desc_hook_t rmnet_perf_ingress;
 	struct rmnet_map_header *qmap, __qmap;
@@ -1653,6 +1857,8 @@ __rmnet_frag_ingress_handler(struct rmnet_frag_descriptor *frag_desc,
 	len = ntohs(qmap->pkt_len) - pad;
 
 	if (qmap->cd_bit) {
+		/* Keep commands ordered with respect to the data */
+		rmnet_frag_sw_coal_flush(coal, port);
 		qmi_rmnet_set_dl_msg_active(port);
 		if (port->data_format & RMNET_INGRESS_FORMAT_DL_MARKER) {
 			rmnet_frag_flow_command(frag_desc, port, len);
@@ -1709,7 +1915,10 @@ __rmnet_frag_ingress_handler(struct rmnet_frag_descriptor *frag_desc,
 
 	list_for_each_entry_safe(frag, tmp, &segs, list) {
 		list_del_init(&frag->list);
-		rmnet_frag_deliver(frag, port);
+		if (port->data_format & RMNET_INGRESS_FORMAT_SW_COAL)
+			rmnet_frag_sw_coal_deliver(coal, frag, port);
+		else
+			rmnet_frag_deliver(frag, port);
 	}
 	return;
 
@@ -1725,6 +1934,7 @@ void rmnet_frag_ingress_handler(struct sk_buff *skb,
 				struct rmnet_port *port)
 {
 	rmnet_perf_chain_hook_t rmnet_perf_opt_chain_end;
+	struct rmnet_frag_sw_coal coal = {};
 	LIST_HEAD(desc_list);
 
 	/* Deaggregation and freeing of HW originating
@@ -1740,7 +1950,8 @@ void rmnet_frag_ingress_handler(struct sk_buff *skb,
 			list_for_each_entry_safe(frag_desc, tmp, &desc_list,
 						 list) {
 				list_del_init(&frag_desc->list);
-				__rmnet_frag_ingress_handler(frag_desc, port);
+				__rmnet_frag_ingress_handler(frag_desc, port,
+							     &coal);
 			}
 		}
 
@@ -1750,6 +1961,8 @@ void rmnet_frag_ingress_handler(struct sk_buff *skb,
 		skb = skb_frag;
 	}
 
+	rmnet_frag_sw_coal_flush(&coal, port);
+
 	rcu_read_lock();
 	rmnet_perf_opt_chain_end = rcu_dereference(rmnet_perf_chain_end);
 	if (rmnet_perf_opt_chain_end)
@@ -1246,72 +1246,207 @@ int rmnet_map_tx_agg_skip(struct sk_buff *skb, int offset)
 	return is_icmp;
 }
 
+static struct sk_buff *rmnet_map_agg_take_skb(struct rmnet_agg_ctx *ctx)
+{
+	struct sk_buff *skb = ctx->agg_skb;
+
+	/* Reset the aggregation state */
+	ctx->agg_skb = NULL;
+	ctx->agg_count = 0;
+	memset(&ctx->agg_time, 0, sizeof(ctx->agg_time));
+	ctx->agg_state = 0;
+
+	return skb;
+}
+
 static void rmnet_map_flush_tx_packet_work(struct work_struct *work)
 {
 	struct sk_buff *skb = NULL;
-	struct rmnet_port *port;
+	struct rmnet_agg_ctx *ctx;
 	unsigned long flags;
 
-	port = container_of(work, struct rmnet_port, agg_wq);
+	ctx = container_of(work, struct rmnet_agg_ctx, agg_wq);
 
-	spin_lock_irqsave(&port->agg_lock, flags);
-	if (likely(port->agg_state == -EINPROGRESS)) {
-		/* Buffer may have already been shipped out */
-		if (likely(port->agg_skb)) {
-			skb = port->agg_skb;
-			port->agg_skb = NULL;
-			port->agg_count = 0;
-			memset(&port->agg_time, 0, sizeof(port->agg_time));
-		}
-		port->agg_state = 0;
-	}
+	spin_lock_irqsave(&ctx->agg_lock, flags);
+	/* Buffer may have already been shipped out */
+	if (likely(ctx->agg_state == -EINPROGRESS))
+		skb = rmnet_map_agg_take_skb(ctx);
+	spin_unlock_irqrestore(&ctx->agg_lock, flags);
 
-	spin_unlock_irqrestore(&port->agg_lock, flags);
 	if (skb)
 		dev_queue_xmit(skb);
 }
 
 enum hrtimer_restart rmnet_map_flush_tx_packet_queue(struct hrtimer *t)
 {
-	struct rmnet_port *port;
+	struct rmnet_agg_ctx *ctx;
 
-	port = container_of(t, struct rmnet_port, hrtimer);
+	ctx = container_of(t, struct rmnet_agg_ctx, hrtimer);
 
-	schedule_work(&port->agg_wq);
+	schedule_work(&ctx->agg_wq);
 	return HRTIMER_NORESTART;
 }
 
-static void rmnet_map_linearize_copy(struct sk_buff *dst, struct sk_buff *src)
+/* Packets up to this size are always copied into the aggregation page, as
+ * attaching them as fragments costs more than the copy itself.
+ */
+#define RMNET_AGG_COPY_THRESHOLD 256
+
+static bool rmnet_map_agg_use_frags(struct rmnet_agg_ctx *ctx)
 {
-	unsigned int linear = src->len - src->data_len, target = src->len;
-	unsigned char *src_buf;
-	struct sk_buff *skb;
+	return (ctx->params.agg_features & RMNET_AGG_PAGE_FRAGS) &&
+	       (ctx->port->dev->features & NETIF_F_SG);
+}
 
-	src_buf = src->data;
-	skb_put_data(dst, src_buf, linear);
-	target -= linear;
+static bool rmnet_map_agg_can_attach(struct rmnet_agg_ctx *ctx,
+				     struct sk_buff *skb)
+{
+	if (!rmnet_map_agg_use_frags(ctx) ||
+	    skb->len <= RMNET_AGG_COPY_THRESHOLD)
+		return false;
 
-	skb = src;
+	/* Only plain page fragments can be referenced directly, and one
+	 * extra fragment may be needed for the linear part.
+	 */
+	if (skb_has_frag_list(skb) || skb_zcopy(skb) ||
+	    skb_shinfo(skb)->nr_frags >= MAX_SKB_FRAGS)
+		return false;
 
-	while (target) {
-		unsigned int i = 0, non_linear = 0;
+	return true;
+}
 
-		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
-			non_linear = skb_frag_size(&skb_shinfo(skb)->frags[i]);
-			src_buf = skb_frag_address(&skb_shinfo(skb)->frags[i]);
+static void rmnet_map_agg_add_frag(struct sk_buff *agg_skb, struct page *page,
+				   unsigned int off, unsigned int size)
+{
+	int i = skb_shinfo(agg_skb)->nr_frags;
 
-			skb_put_data(dst, src_buf, non_linear);
-			target -= non_linear;
-		}
+	if (skb_can_coalesce(agg_skb, i, page, off)) {
+		skb_frag_size_add(&skb_shinfo(agg_skb)->frags[i - 1], size);
+	} else {
+		get_page(page);
+		skb_fill_page_desc(agg_skb, i, page, off, size);
+	}
 
-		if (skb_shinfo(skb)->frag_list) {
-			skb = skb_shinfo(skb)->frag_list;
-			continue;
-		}
+	agg_skb->len += size;
+	agg_skb->data_len += size;
+}
+
+/* Copy len bytes of src starting at offset into the aggregation page. Data
+ * goes into the linear area until the first fragment has been attached.
+ * After that, the remainder of the page is handed out as fragments so that
+ * the byte order of the MAP frame is preserved.
+ */
+static void rmnet_map_agg_copy(struct rmnet_agg_ctx *ctx, struct sk_buff *src,
+			       int offset, unsigned int len)
+{
+	struct sk_buff *agg_skb = ctx->agg_skb;
+	struct page *page;
+	u8 *dst;
 
-		if (skb->next)
-			skb = skb->next;
+	if (!len)
+		return;
+
+	dst = agg_skb->head + ctx->agg_copy_off;
+	if (!skb_shinfo(agg_skb)->nr_frags) {
+		skb_put(agg_skb, len);
+	} else {
+		page = virt_to_head_page(agg_skb->head);
+		rmnet_map_agg_add_frag(agg_skb, page,
+				       dst - (u8 *)page_address(page), len);
+	}
+
+	skb_copy_bits(src, offset, dst, len);
+	ctx->agg_copy_off += len;
+}
+
+/* Returns true if len bytes can be copied into the aggregation page. Once
+ * fragments have been attached, the copy becomes another fragment, so it
+ * needs a free slot unless it extends the last one.
+ */
+static bool rmnet_map_agg_copy_fits(struct rmnet_agg_ctx *ctx,
+				    unsigned int len)
+{
+	struct sk_buff *agg_skb = ctx->agg_skb;
+	int i = skb_shinfo(agg_skb)->nr_frags;
+	struct page *page;
+	u8 *dst;
+
+	if (len > skb_end_offset(agg_skb) - ctx->agg_copy_off)
+		return false;
+
+	if (i < MAX_SKB_FRAGS)
+		return true;
+
+	dst = agg_skb->head + ctx->agg_copy_off;
+	page = virt_to_head_page(agg_skb->head);
+	return skb_can_coalesce(agg_skb, i, page,
+				dst - (u8 *)page_address(page));
+}
+
+/* Reference the data of skb from the aggregation buffer without copying the
+ * payload. The linear part, which holds the MAP headers, is only referenced
+ * if it lives in a page fragment that no clone shares; a cloned TCP skb may
+ * get its headers rewritten for a retransmit while still queued here.
+ */
+static void rmnet_map_agg_attach(struct rmnet_agg_ctx *ctx,
+				 struct sk_buff *skb)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned int headlen = skb_headlen(skb);
+	struct sk_buff *agg_skb = ctx->agg_skb;
+	struct page *page;
+	int i;
+
+	if (skb->head_frag && headlen && !skb_cloned(skb)) {
+		page = virt_to_head_page(skb->head);
+		rmnet_map_agg_add_frag(agg_skb, page,
+				       skb->data - (u8 *)page_address(page),
+				       headlen);
+		agg_skb->truesize += headlen;
+	} else {
+		rmnet_map_agg_copy(ctx, skb, 0, headlen);
+	}
+
+	for (i = 0; i < shinfo->nr_frags; i++) {
+		skb_frag_t *frag = &shinfo->frags[i];
+
+		rmnet_map_agg_add_frag(agg_skb, skb_frag_page(frag),
+				       skb_frag_off(frag),
+				       skb_frag_size(frag));
+		agg_skb->truesize += skb_frag_size(frag);
 	}
+
+	ctx->ul_agg_frag++;
+}
+
+/* Returns true if skb can be added to the current aggregation buffer */
+static bool rmnet_map_agg_has_room(struct rmnet_agg_ctx *ctx,
+				   struct sk_buff *skb)
+{
+	struct sk_buff *agg_skb = ctx->agg_skb;
+	int nr_frags;
+
+	if (agg_skb->len + skb->len > ctx->params.agg_size)
+		return false;
+
+	if (!rmnet_map_agg_can_attach(ctx, skb))
+		return rmnet_map_agg_copy_fits(ctx, skb->len);
+
+	/* One fragment for the header and one per page of the packet */
+	nr_frags = skb_shinfo(agg_skb)->nr_frags + skb_shinfo(skb)->nr_frags + 1;
+	if (nr_frags > MAX_SKB_FRAGS)
+		return false;
+
+	return skb_headlen(skb) <=
+	       skb_end_offset(agg_skb) - ctx->agg_copy_off;
+}
+
+static void rmnet_map_agg_add(struct rmnet_agg_ctx *ctx, struct sk_buff *skb)
+{
+	if (rmnet_map_agg_can_attach(ctx, skb))
+		rmnet_map_agg_attach(ctx, skb);
+	else
+		rmnet_map_agg_copy(ctx, skb, 0, skb->len);
 }
 
 static void rmnet_free_agg_pages(struct rmnet_port *port)
@@ -1407,12 +1542,16 @@ static struct sk_buff *rmnet_map_build_skb(struct rmnet_port *port)
 	struct page *page;
 	void *vaddr;
 
+	/* The page pool is shared by all aggregation contexts */
+	spin_lock(&port->agg_lock);
 	page = rmnet_get_agg_pages(port);
+	size = PAGE_SIZE << port->agg_size_order;
+	spin_unlock(&port->agg_lock);
+
 	if (!page)
 		return NULL;
 
 	vaddr = page_address(page);
-	size = PAGE_SIZE << port->agg_size_order;
 
 	skb = build_skb(vaddr, size);
 	if (!skb) {
@@ -1423,142 +1562,212 @@ static struct sk_buff *rmnet_map_build_skb(struct rmnet_port *port)
 	return skb;
 }
 
-static void rmnet_map_send_agg_skb(struct rmnet_port *port, unsigned long flags)
+static void rmnet_map_send_agg_skb(struct rmnet_agg_ctx *ctx,
+				   unsigned long flags)
 {
 	struct sk_buff *agg_skb;
 
-	if (!port->agg_skb) {
-		spin_unlock_irqrestore(&port->agg_lock, flags);
+	if (!ctx->agg_skb) {
+		spin_unlock_irqrestore(&ctx->agg_lock, flags);
 		return;
 	}
 
-	agg_skb = port->agg_skb;
-	/* Reset the aggregation state */
-	port->agg_skb = NULL;
-	port->agg_count = 0;
-	memset(&port->agg_time, 0, sizeof(port->agg_time));
-	port->agg_state = 0;
-	spin_unlock_irqrestore(&port->agg_lock, flags);
-	hrtimer_cancel(&port->hrtimer);
+	agg_skb = rmnet_map_agg_take_skb(ctx);
+	spin_unlock_irqrestore(&ctx->agg_lock, flags);
+	hrtimer_cancel(&ctx->hrtimer);
 	dev_queue_xmit(agg_skb);
 }
 
+/* Copy the port's aggregation parameters into ctx, consistently even while
+ * rmnet_map_update_ul_agg_config() or a changelink rewrites them.
+ */
+static void rmnet_map_agg_read_params(struct rmnet_agg_ctx *ctx)
+{
+	struct rmnet_port *port = ctx->port;
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&port->agg_params_seq);
+		ctx->params = port->egress_agg_params;
+	} while (read_seqcount_retry(&port->agg_params_seq, seq));
+}
+
+/* Each TX CPU aggregates into its own context. Packets of a flow are kept on
+ * one CPU by XPS, so the per-flow order is preserved without a shared lock.
+ */
 void rmnet_map_tx_aggregate(struct sk_buff *skb, struct rmnet_port *port)
 {
+	struct rmnet_agg_ctx *ctx = this_cpu_ptr(port->agg_ctx);
 	struct timespec64 diff, last;
 	int size;
 	unsigned long flags;
 
 new_packet:
-	spin_lock_irqsave(&port->agg_lock, flags);
-	memcpy(&last, &port->agg_last, sizeof(last));
-	ktime_get_real_ts64(&port->agg_last);
+	spin_lock_irqsave(&ctx->agg_lock, flags);
+	rmnet_map_agg_read_params(ctx);
+	memcpy(&last, &ctx->agg_last, sizeof(last));
+	ktime_get_real_ts64(&ctx->agg_last);
 
 	if ((port->data_format & RMNET_EGRESS_FORMAT_PRIORITY) &&
 	    skb->priority) {
 		/* Send out any aggregated SKBs we have */
-		rmnet_map_send_agg_skb(port, flags);
+		rmnet_map_send_agg_skb(ctx, flags);
 		/* Send out the priority SKB. Not holding agg_lock anymore */
 		skb->protocol = htons(ETH_P_MAP);
 		dev_queue_xmit(skb);
 		return;
 	}
 
-	if (!port->agg_skb) {
+	if (!ctx->agg_skb) {
 		/* Check to see if we should agg first. If the traffic is very
 		 * sparse, don't aggregate. We will need to tune this later
 		 */
-		diff = timespec64_sub(port->agg_last, last);
-		size = port->egress_agg_params.agg_size - skb->len;
+		diff = timespec64_sub(ctx->agg_last, last);
+		size = ctx->params.agg_size - skb->len;
 
 		if (diff.tv_sec > 0 || diff.tv_nsec > rmnet_agg_bypass_time ||
 		    size <= 0) {
-			spin_unlock_irqrestore(&port->agg_lock, flags);
+			spin_unlock_irqrestore(&ctx->agg_lock, flags);
 			skb->protocol = htons(ETH_P_MAP);
 			dev_queue_xmit(skb);
 			return;
 		}
 
-		port->agg_skb = rmnet_map_build_skb(port);
-		if (!port->agg_skb) {
-			port->agg_skb = 0;
-			port->agg_count = 0;
-			memset(&port->agg_time, 0, sizeof(port->agg_time));
-			spin_unlock_irqrestore(&port->agg_lock, flags);
+		ctx->agg_skb = rmnet_map_build_skb(port);
+		if (!ctx->agg_skb) {
+			rmnet_map_agg_take_skb(ctx);
+			spin_unlock_irqrestore(&ctx->agg_lock, flags);
 			skb->protocol = htons(ETH_P_MAP);
 			dev_queue_xmit(skb);
 			return;
 		}
 
-		rmnet_map_linearize_copy(port->agg_skb, skb);
-		port->agg_skb->dev = skb->dev;
-		port->agg_skb->protocol = htons(ETH_P_MAP);
-		port->agg_count = 1;
-		ktime_get_real_ts64(&port->agg_time);
+		ctx->agg_copy_off = 0;
+		rmnet_map_agg_add(ctx, skb);
+		ctx->agg_skb->dev = skb->dev;
+		ctx->agg_skb->protocol = htons(ETH_P_MAP);
+		ctx->agg_count = 1;
+		ktime_get_real_ts64(&ctx->agg_time);
 		dev_kfree_skb_any(skb);
 		goto schedule;
 	}
-	diff = timespec64_sub(port->agg_last, port->agg_time);
-	size = skb_tailroom(port->agg_skb);
+	diff = timespec64_sub(ctx->agg_last, ctx->agg_time);
 
-	if (skb->len > size ||
-	    port->agg_count >= port->egress_agg_params.agg_count ||
+	if (!rmnet_map_agg_has_room(ctx, skb) ||
+	    ctx->agg_count >= ctx->params.agg_count ||
 	    diff.tv_sec > 0 || diff.tv_nsec > rmnet_agg_time_limit) {
-		rmnet_map_send_agg_skb(port, flags);
+		rmnet_map_send_agg_skb(ctx, flags);
 		goto new_packet;
 	}
 
-	rmnet_map_linearize_copy(port->agg_skb, skb);
-	port->agg_count++;
+	rmnet_map_agg_add(ctx, skb);
+	ctx->agg_count++;
 	dev_kfree_skb_any(skb);
 
 schedule:
-	if (port->agg_state != -EINPROGRESS) {
-		port->agg_state = -EINPROGRESS;
-		hrtimer_start(&port->hrtimer,
-			      ns_to_ktime(port->egress_agg_params.agg_time),
+	if (ctx->agg_state != -EINPROGRESS) {
+		ctx->agg_state = -EINPROGRESS;
+		hrtimer_start(&ctx->hrtimer,
+			      ns_to_ktime(ctx->params.agg_time),
 			      HRTIMER_MODE_REL);
 	}
-	spin_unlock_irqrestore(&port->agg_lock, flags);
+	spin_unlock_irqrestore(&ctx->agg_lock, flags);
 }
 
 void rmnet_map_update_ul_agg_config(struct rmnet_port *port, u16 size,
 				    u8 count, u8 features, u32 time)
 {
 	unsigned long irq_flags;
+	bool recycle;
 
 	spin_lock_irqsave(&port->agg_lock, irq_flags);
-	port->egress_agg_params.agg_count = count;
-	port->egress_agg_params.agg_time = time;
-	port->egress_agg_params.agg_size = size;
-	port->egress_agg_params.agg_features = features;
-
 	rmnet_free_agg_pages(port);
 
 	/* This effectively disables recycling in case the UL aggregation
 	 * size is lesser than PAGE_SIZE.
 	 */
-	if (size < PAGE_SIZE)
-		goto done;
+	recycle = size >= PAGE_SIZE && (features & RMNET_PAGE_RECYCLE);
+	if (size >= PAGE_SIZE) {
+		port->agg_size_order = get_order(size);
 
-	port->agg_size_order = get_order(size);
+		size = PAGE_SIZE << port->agg_size_order;
+		size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	}
 
-	size = PAGE_SIZE << port->agg_size_order;
-	size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	/* Aggregating CPUs spin while this is open, so keep it short */
+	write_seqcount_begin(&port->agg_params_seq);
+	port->egress_agg_params.agg_count = count;
+	port->egress_agg_params.agg_time = time;
 	port->egress_agg_params.agg_size = size;
+	port->egress_agg_params.agg_features = features;
+	write_seqcount_end(&port->agg_params_seq);
 
-	if (port->egress_agg_params.agg_features == RMNET_PAGE_RECYCLE)
+	if (recycle)
 		rmnet_alloc_agg_pages(port);
 
-done:
 	spin_unlock_irqrestore(&port->agg_lock, irq_flags);
 }
 
-void rmnet_map_tx_aggregate_init(struct rmnet_port *port)
+/* Sum of the per-CPU counts of packets attached as fragments */
+u64 rmnet_map_ul_agg_frag(struct rmnet_port *port)
+{
+	struct rmnet_agg_ctx *ctx;
+	unsigned long flags;
+	u64 count = 0;
+	int cpu;
+
+	if (!port->agg_ctx)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(port->agg_ctx, cpu);
+
+		spin_lock_irqsave(&ctx->agg_lock, flags);
+		count += ctx->ul_agg_frag;
+		spin_unlock_irqrestore(&ctx->agg_lock, flags);
+	}
+
+	return count;
+}
+
+void rmnet_map_ul_agg_frag_reset(struct rmnet_port *port)
+{
+	struct rmnet_agg_ctx *ctx;
+	unsigned long flags;
+	int cpu;
+
+	if (!port->agg_ctx)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(port->agg_ctx, cpu);
+
+		spin_lock_irqsave(&ctx->agg_lock, flags);
+		ctx->ul_agg_frag = 0;
+		spin_unlock_irqrestore(&ctx->agg_lock, flags);
+	}
+}
+
+int rmnet_map_tx_aggregate_init(struct rmnet_port *port)
 {
-	hrtimer_init(&port->hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-	port->hrtimer.function = rmnet_map_flush_tx_packet_queue;
+	struct rmnet_agg_ctx *ctx;
+	int cpu;
+
+	port->agg_ctx = alloc_percpu(struct rmnet_agg_ctx);
+	if (!port->agg_ctx)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(port->agg_ctx, cpu);
+		ctx->port = port;
+		spin_lock_init(&ctx->agg_lock);
+		hrtimer_init(&ctx->hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		ctx->hrtimer.function = rmnet_map_flush_tx_packet_queue;
+		INIT_WORK(&ctx->agg_wq, rmnet_map_flush_tx_packet_work);
+	}
+
 	spin_lock_init(&port->agg_lock);
+	seqcount_init(&port->agg_params_seq);
 	INIT_LIST_HEAD(&port->agg_list);
 
 	/* Since PAGE_SIZE - 1 is specified here, no pages are pre-allocated.
@@ -1568,53 +1777,62 @@ void rmnet_map_tx_aggregate_init(struct rmnet_port *port)
 	 */
 	rmnet_map_update_ul_agg_config(port, PAGE_SIZE - 1, 20, 0, 3000000);
 
-	INIT_WORK(&port->agg_wq, rmnet_map_flush_tx_packet_work);
+	return 0;
 }
 
 void rmnet_map_tx_aggregate_exit(struct rmnet_port *port)
 {
+	struct rmnet_agg_ctx *ctx;
 	unsigned long flags;
+	int cpu;
+
+	if (!port->agg_ctx)
+		return;
 
-	hrtimer_cancel(&port->hrtimer);
-	cancel_work_sync(&port->agg_wq);
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(port->agg_ctx, cpu);
 
-	spin_lock_irqsave(&port->agg_lock, flags);
-	if (port->agg_state == -EINPROGRESS) {
-		if (port->agg_skb) {
-			kfree_skb(port->agg_skb);
-			port->agg_skb = NULL;
-			port->agg_count = 0;
-			memset(&port->agg_time, 0, sizeof(port->agg_time));
-		}
+		hrtimer_cancel(&ctx->hrtimer);
+		cancel_work_sync(&ctx->agg_wq);
 
-		port->agg_state = 0;
+		spin_lock_irqsave(&ctx->agg_lock, flags);
+		if (ctx->agg_state == -EINPROGRESS)
+			kfree_skb(rmnet_map_agg_take_skb(ctx));
+		spin_unlock_irqrestore(&ctx->agg_lock, flags);
 	}
 
+	spin_lock_irqsave(&port->agg_lock, flags);
 	rmnet_free_agg_pages(port);
 	spin_unlock_irqrestore(&port->agg_lock, flags);
+
+	free_percpu(port->agg_ctx);
+	port->agg_ctx = NULL;
 }
 
 void rmnet_map_tx_qmap_cmd(struct sk_buff *qmap_skb)
 {
+	struct rmnet_agg_ctx *ctx;
 	struct rmnet_port *port;
 	struct sk_buff *agg_skb;
 	unsigned long flags;
+	int cpu;
 
 	port = rmnet_get_port(qmap_skb->dev);
 
 	if (port && (port->data_format & RMNET_EGRESS_FORMAT_AGGREGATION)) {
-		spin_lock_irqsave(&port->agg_lock, flags);
-		if (port->agg_skb) {
-			agg_skb = port->agg_skb;
-			port->agg_skb = 0;
-			port->agg_count = 0;
-			memset(&port->agg_time, 0, sizeof(port->agg_time));
-			port->agg_state = 0;
-			spin_unlock_irqrestore(&port->agg_lock, flags);
-			hrtimer_cancel(&port->hrtimer);
-			dev_queue_xmit(agg_skb);
-		} else {
-			spin_unlock_irqrestore(&port->agg_lock, flags);
+		/* Commands must not overtake data queued on any CPU */
+		for_each_possible_cpu(cpu) {
+			ctx = per_cpu_ptr(port->agg_ctx, cpu);
+
+			spin_lock_irqsave(&ctx->agg_lock, flags);
+			if (ctx->agg_skb) {
+				agg_skb = rmnet_map_agg_take_skb(ctx);
+				spin_unlock_irqrestore(&ctx->agg_lock, flags);
+				hrtimer_cancel(&ctx->hrtimer);
+				dev_queue_xmit(agg_skb);
+			} else {
+				spin_unlock_irqrestore(&ctx->agg_lock, flags);
+			}
 		}
 	}
 
@@ -37,8 +37,12 @@ RMNET_INGRESS_FORMAT_DL_MARKER_V2)
 #define RMNET_INGRESS_FORMAT_PS                 BIT(27)
 #define RMNET_FORMAT_PS_NOTIF                   BIT(26)
 
+/* Software coalescing of downlink TCP segments */
+#define RMNET_INGRESS_FORMAT_SW_COAL            BIT(25)
+
 /* UL Aggregation parameters */
 #define RMNET_PAGE_RECYCLE                      BIT(0)
+#define RMNET_AGG_PAGE_FRAGS                    BIT(1)
 
 /* Replace skb->dev to a virtual rmnet device and pass up the stack */
 #define RMNET_EPMODE_VND (1)
@@ -267,6 +267,7 @@ static const char rmnet_gstrings_stats[][ETH_GSTRING_LEN] = {
 	"Coalescing UDP frames",
 	"Coalescing UDP bytes",
 	"Uplink priority packets",
+	"SW coalesced packets",
 };
 
 static const char rmnet_port_gstrings_stats[][ETH_GSTRING_LEN] = {
@@ -284,6 +285,7 @@ static const char rmnet_port_gstrings_stats[][ETH_GSTRING_LEN] = {
 	"DL trailer pkts received",
 	"UL agg reuse",
 	"UL agg alloc",
+	"UL agg frag attach",
 };
 
 static void rmnet_get_strings(struct net_device *dev, u32 stringset, u8 *buf)
@@ -315,7 +317,7 @@ static void rmnet_get_ethtool_stats(struct net_device *dev,
 {
 	struct rmnet_priv *priv = netdev_priv(dev);
 	struct rmnet_priv_stats *st = &priv->stats;
-	struct rmnet_port_priv_stats *stp;
+	struct rmnet_port_priv_stats stp;
 	struct rmnet_port *port;
 
 	port = rmnet_get_port(priv->real_dev);
@@ -323,10 +325,11 @@ static void rmnet_get_ethtool_stats(struct net_device *dev,
 	if (!data || !port)
 		return;
 
-	stp = &port->stats;
+	stp = port->stats;
+	stp.agg.ul_agg_frag = rmnet_map_ul_agg_frag(port);
 
 	memcpy(data, st, ARRAY_SIZE(rmnet_gstrings_stats) * sizeof(u64));
-	memcpy(data + ARRAY_SIZE(rmnet_gstrings_stats), stp,
+	memcpy(data + ARRAY_SIZE(rmnet_gstrings_stats), &stp,
 	       ARRAY_SIZE(rmnet_port_gstrings_stats) * sizeof(u64));
 }
 
@@ -344,6 +347,7 @@ static int rmnet_stats_reset(struct net_device *dev)
 	stp = &port->stats;
 
 	memset(stp, 0, sizeof(*stp));
+	rmnet_map_ul_agg_frag_reset(port);
 
 	st = &priv->stats;
 
@@ -19,7 +19,7 @@
  *   The test currently runs for
  *   - TPACKET_V1: RX_RING, TX_RING
  *   - TPACKET_V2: RX_RING, TX_RING
- *   - TPACKET_V3: RX_RING
+ *   - TPACKET_V3: RX_RING, RX_RING with per-CPU block queues
  */
 
 #include <stdio.h>
@@ -60,7 +60,12 @@
 # define __align_tpacket(x)	__attribute__((aligned(TPACKET_ALIGN(x))))
 #endif
 
+#ifndef TP_FT_REQ_PER_CPU
+# define TP_FT_REQ_PER_CPU	0x2
+#endif
+
 #define NUM_PACKETS		100
+#define PER_CPU_BLOCKS		8
 #define ALIGN_8(x)		(((x) + 8 - 1) & ~(8 - 1))
 
 struct ring {
@@ -70,6 +75,7 @@ struct ring {
 	struct sockaddr_ll ll;
 	void (*walk)(int sock, struct ring *ring);
 	int type, rd_num, flen, version;
+	int cpu_blocks;
 	union {
 		struct tpacket_req  req;
 		struct tpacket_req3 req3;
@@ -619,9 +625,92 @@ static void walk_v3_rx(int sock, struct ring *ring)
 	fprintf(stderr, " %u pkts (%u bytes)", NUM_PACKETS, total_bytes >> 1);
 }
 
+/* Each CPU fills its own slice of cpu_blocks blocks, in order */
+static void walk_v3_rx_per_cpu(int sock, struct ring *ring)
+{
+	unsigned int cpu, cpus = ring->rd_num / ring->cpu_blocks;
+	unsigned int *cur_block, block_num;
+	uint64_t *cpu_seq_num;
+	struct tpacket_stats_v3 stats;
+	socklen_t len = sizeof(stats);
+	struct pollfd pfd;
+	struct block_desc *pbd;
+	int udp_sock[2], found;
+
+	bug_on(ring->type != PACKET_RX_RING);
+
+	cur_block = calloc(cpus, sizeof(*cur_block));
+	cpu_seq_num = calloc(cpus, sizeof(*cpu_seq_num));
+	if (!cur_block || !cpu_seq_num) {
+		perror("calloc");
+		exit(1);
+	}
+
+	pair_udp_open(udp_sock, PORT_BASE);
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = sock;
+	pfd.events = POLLIN | POLLERR;
+	pfd.revents = 0;
+
+	pair_udp_send(udp_sock, NUM_PACKETS);
+
+	while (total_packets < NUM_PACKETS * 2) {
+		found = 0;
+
+		for (cpu = 0; cpu < cpus; cpu++) {
+			block_num = cpu * ring->cpu_blocks + cur_block[cpu];
+			pbd = (struct block_desc *) ring->rd[block_num].iov_base;
+
+			if ((pbd->h1.block_status & TP_STATUS_USER) == 0)
+				continue;
+
+			/* Block sequence numbers are per queue */
+			__v3_prev_block_seq_num = cpu_seq_num[cpu];
+			__v3_walk_block(pbd, block_num);
+			cpu_seq_num[cpu] = __v3_prev_block_seq_num;
+			__v3_flush_block(pbd);
+
+			cur_block[cpu] = (cur_block[cpu] + 1) % ring->cpu_blocks;
+			found = 1;
+		}
+
+		if (!found)
+			poll(&pfd, 1, 1);
+	}
+
+	pair_udp_close(udp_sock);
+
+	if (total_packets != 2 * NUM_PACKETS) {
+		fprintf(stderr, "walk_v3_rx_per_cpu: received %u out of %u pkts\n",
+			total_packets, NUM_PACKETS);
+		exit(1);
+	}
+
+	/* The per-CPU queue counters must add up to what was walked */
+	if (getsockopt(sock, SOL_PACKET, PACKET_STATISTICS, &stats, &len)) {
+		perror("getsockopt");
+		exit(1);
+	}
+
+	if (stats.tp_packets != total_packets) {
+		fprintf(stderr, "walk_v3_rx_per_cpu: stats report %u out of %u pkts\n",
+			stats.tp_packets, total_packets);
+		exit(1);
+	}
+
+	free(cpu_seq_num);
+	free(cur_block);
+
+	fprintf(stderr, " %u pkts (%u bytes) over %u queues", NUM_PACKETS,
+		total_bytes >> 1, cpus);
+}
+
 static void walk_v3(int sock, struct ring *ring)
 {
-	if (ring->type == PACKET_RX_RING)
+	if (ring->type == PACKET_RX_RING && ring->cpu_blocks)
+		walk_v3_rx_per_cpu(sock, ring);
+	else if (ring->type == PACKET_RX_RING)
 		walk_v3_rx(sock, ring);
 	else
 		walk_tx(sock, ring);
@@ -643,12 +732,39 @@ static void __v1_v2_fill(struct ring *ring, unsigned int blocks)
 	ring->flen = ring->req.tp_frame_size;
 }
 
+/* Number of possible CPU ids, which the per-CPU queues are split over */
+static unsigned int nr_cpu_ids(void)
+{
+	unsigned int last = 0;
+	char buf[256], *p;
+	FILE *f;
+
+	f = fopen("/sys/devices/system/cpu/possible", "r");
+	if (!f || !fgets(buf, sizeof(buf), f)) {
+		perror("/sys/devices/system/cpu/possible");
+		exit(1);
+	}
+	fclose(f);
+
+	/* e.g. "0-3,8-11": the id after the last separator is the highest */
+	p = strrchr(buf, '-');
+	if (!p || strrchr(buf, ',') > p)
+		p = strrchr(buf, ',');
+	last = strtoul(p ? p + 1 : buf, NULL, 10);
+
+	return last + 1;
+}
+
 static void __v3_fill(struct ring *ring, unsigned int blocks, int type)
 {
 	if (type == PACKET_RX_RING) {
 		ring->req3.tp_retire_blk_tov = 64;
 		ring->req3.tp_sizeof_priv = 0;
 		ring->req3.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+		if (ring->cpu_blocks) {
+			ring->req3.tp_feature_req_word |= TP_FT_REQ_PER_CPU;
+			blocks = ring->cpu_blocks * nr_cpu_ids();
+		}
 	}
 	ring->req3.tp_block_size = getpagesize() << 2;
 	ring->req3.tp_frame_size = TPACKET_ALIGNMENT << 7;
@@ -799,13 +915,13 @@ static const char *type_str[] = {
 	[PACKET_TX_RING] = "PACKET_TX_RING",
 };
 
-static int test_tpacket(int version, int type)
+static int __test_tpacket(int version, int type, int cpu_blocks)
 {
 	int sock;
 	struct ring ring;
 
-	fprintf(stderr, "test: %s with %s ", tpacket_str[version],
-		type_str[type]);
+	fprintf(stderr, "test: %s with %s%s ", tpacket_str[version],
+		type_str[type], cpu_blocks ? " per CPU" : "");
 	fflush(stderr);
 
 	if (version == TPACKET_V1 &&
@@ -818,6 +934,7 @@ static int test_tpacket(int version, int type)
 
 	sock = pfsocket(version);
 	memset(&ring, 0, sizeof(ring));
+	ring.cpu_blocks = cpu_blocks;
 	setup_ring(sock, &ring, version, type);
 	mmap_ring(sock, &ring);
 	bind_ring(sock, &ring);
@@ -829,6 +946,11 @@ static int test_tpacket(int version, int type)
 	return 0;
 }
 
+static int test_tpacket(int version, int type)
+{
+	return __test_tpacket(version, type, 0);
+}
+
 int main(void)
 {
 	int ret = 0;
@@ -840,6 +962,7 @@ int main(void)
 	ret |= test_tpacket(TPACKET_V2, PACKET_TX_RING);
 
 	ret |= test_tpacket(TPACKET_V3, PACKET_RX_RING);
+	ret |= __test_tpacket(TPACKET_V3, PACKET_RX_RING, PER_CPU_BLOCKS);
 	ret |= test_tpacket(TPACKET_V3, PACKET_TX_RING);
 
 	if (ret)
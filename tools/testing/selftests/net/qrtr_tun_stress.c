@@ -0,0 +1,530 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stress the QRTR receive path through /dev/qrtr-tun
+ *
+ * Binds a set of local AF_QIPCRTR sockets, then has several threads inject
+ * data packets "from the remote node" into the tun endpoint, each one aimed
+ * at a randomly chosen local port. Every injected packet has to go through
+ * the node and port lookups, so this exercises those with many concurrent
+ * readers. Meanwhile a churn thread keeps closing and re-binding sockets to
+ * race port removal against delivery.
+ *
+ * With -b the ports are drained with recvmmsg() in batches instead of one
+ * recv() per message.
+ *
+ * Every payload is tagged with its destination port and a sequence number
+ * and checked on receipt. After the run, a few packets are injected to each
+ * port and must all arrive, in order, and a sendmmsg() batch is sent to the
+ * remote node and must come out of the tun endpoint unchanged.
+ *
+ * Reports the injected and received message rate at the end of the run.
+ */
+
+#define _GNU_SOURCE
+
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/qrtr.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef AF_QIPCRTR
+#define AF_QIPCRTR	42
+#endif
+
+#define QRTR_PROTO_VER_1	1
+#define QRTR_TYPE_DATA		1
+
+#define MAX_PORTS	256
+#define MAX_THREADS	64
+#define MAX_BATCH	64
+#define RX_BUF_LEN	4096
+#define CHECK_MSGS	8
+#define CHECK_PORT	0x5000
+#define CHECK_WAIT_MS	1000
+
+struct qrtr_hdr_v1 {
+	uint32_t version;
+	uint32_t type;
+	uint32_t src_node_id;
+	uint32_t src_port_id;
+	uint32_t confirm_rx;
+	uint32_t size;
+	uint32_t dst_node_id;
+	uint32_t dst_port_id;
+};
+
+/* start of every payload, the rest is filled with a pattern based on seq */
+struct payload_tag {
+	uint32_t port;
+	uint32_t seq;
+};
+
+static const char *cfg_dev	= "/dev/qrtr-tun";
+static int	cfg_num_ports	= 16;
+static int	cfg_num_threads	= 4;
+static int	cfg_payload_len	= 64;
+static int	cfg_runtime_s	= 5;
+static uint32_t	cfg_remote_node	= 1000;
+static int	cfg_batch	= 1;
+static bool	cfg_churn;
+
+static int tun_fd;
+static uint32_t local_node;
+static volatile bool stop;
+
+static struct {
+	int fd;
+	uint32_t port;
+	pthread_mutex_t lock;
+} ports[MAX_PORTS];
+
+static unsigned long tx_total[MAX_THREADS];
+static unsigned long tx_errors[MAX_THREADS];
+static unsigned long rx_total;
+static unsigned long rx_bad;
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static void fill_payload(char *p, uint32_t port, uint32_t seq)
+{
+	struct payload_tag *tag = (void *)p;
+	int i;
+
+	tag->port = port;
+	tag->seq = seq;
+	for (i = sizeof(*tag); i < cfg_payload_len; i++)
+		p[i] = seq + i;
+}
+
+/* check a payload sent to @port, returns its seq or -1 if it's corrupt */
+static int64_t check_payload(const char *p, ssize_t len, uint32_t port)
+{
+	const struct payload_tag *tag = (const void *)p;
+	int i;
+
+	if (len != cfg_payload_len)
+		return -1;
+	/* with churn, a closed port's number may be handed out again */
+	if (!cfg_churn && tag->port != port)
+		return -1;
+	for (i = sizeof(*tag); i < cfg_payload_len; i++)
+		if (p[i] != (char)(tag->seq + i))
+			return -1;
+
+	return tag->seq;
+}
+
+static int open_port(uint32_t *port)
+{
+	struct sockaddr_qrtr sq;
+	socklen_t sl = sizeof(sq);
+	int fd;
+
+	fd = socket(AF_QIPCRTR, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	/* an unbound socket reports the local node; port 0 asks for any port */
+	if (getsockname(fd, (void *)&sq, &sl))
+		error(1, errno, "getsockname");
+	sq.sq_port = 0;
+	if (bind(fd, (void *)&sq, sizeof(sq)))
+		error(1, errno, "bind");
+	sl = sizeof(sq);
+	if (getsockname(fd, (void *)&sq, &sl))
+		error(1, errno, "getsockname");
+
+	local_node = sq.sq_node;
+	*port = sq.sq_port;
+	return fd;
+}
+
+static void *do_inject(void *arg)
+{
+	long id = (long)arg;
+	unsigned int seed = id;
+	size_t len = sizeof(struct qrtr_hdr_v1) + ((cfg_payload_len + 3) & ~3);
+	struct qrtr_hdr_v1 *hdr;
+	uint32_t seq = 0;
+	char *buf;
+
+	buf = calloc(1, len);
+	if (!buf)
+		error(1, ENOMEM, "calloc");
+	hdr = (void *)buf;
+
+	hdr->version = QRTR_PROTO_VER_1;
+	hdr->type = QRTR_TYPE_DATA;
+	hdr->src_node_id = cfg_remote_node;
+	hdr->src_port_id = 0x4000 + id;
+	hdr->size = cfg_payload_len;
+	hdr->dst_node_id = local_node;
+
+	while (!stop) {
+		int i = rand_r(&seed) % cfg_num_ports;
+
+		hdr->dst_port_id = __atomic_load_n(&ports[i].port,
+						   __ATOMIC_RELAXED);
+		fill_payload(buf + sizeof(*hdr), hdr->dst_port_id, seq++);
+		if (write(tun_fd, buf, len) != len)
+			tx_errors[id]++;
+		else
+			tx_total[id]++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *do_churn(void *arg)
+{
+	unsigned int seed = 1;
+
+	while (!stop) {
+		int i = rand_r(&seed) % cfg_num_ports;
+		uint32_t port;
+		int fd;
+
+		pthread_mutex_lock(&ports[i].lock);
+		close(ports[i].fd);
+		fd = open_port(&port);
+		ports[i].fd = fd;
+		__atomic_store_n(&ports[i].port, port, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&ports[i].lock);
+
+		usleep(100);
+	}
+
+	return NULL;
+}
+
+static void drain_port(int fd, uint32_t port)
+{
+	static char bufs[MAX_BATCH][RX_BUF_LEN];
+	static struct mmsghdr msgs[MAX_BATCH];
+	static struct iovec iov[MAX_BATCH];
+	ssize_t len;
+	int i, ret;
+
+	if (cfg_batch == 1) {
+		while ((len = recv(fd, bufs[0], RX_BUF_LEN, 0)) > 0) {
+			if (check_payload(bufs[0], len, port) < 0)
+				rx_bad++;
+			rx_total++;
+		}
+		return;
+	}
+
+	for (i = 0; i < cfg_batch; i++) {
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = RX_BUF_LEN;
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while ((ret = recvmmsg(fd, msgs, cfg_batch, 0, NULL)) > 0) {
+		for (i = 0; i < ret; i++)
+			if (check_payload(bufs[i], msgs[i].msg_len, port) < 0)
+				rx_bad++;
+		rx_total += ret;
+	}
+}
+
+static void drain_ports(void)
+{
+	int i;
+
+	for (i = 0; i < cfg_num_ports; i++) {
+		pthread_mutex_lock(&ports[i].lock);
+		drain_port(ports[i].fd, ports[i].port);
+		pthread_mutex_unlock(&ports[i].lock);
+	}
+}
+
+static void drain_tun(void)
+{
+	char buf[4096];
+
+	while (read(tun_fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+/*
+ * Inject CHECK_MSGS packets to every port, now that nothing else is running,
+ * and expect each port to receive all of its packets in order.
+ */
+static int check_delivery(void)
+{
+	size_t len = sizeof(struct qrtr_hdr_v1) + ((cfg_payload_len + 3) & ~3);
+	int received[MAX_PORTS] = {0};
+	struct qrtr_hdr_v1 *hdr;
+	unsigned long tstart;
+	char buf[RX_BUF_LEN];
+	int i, done = 0, errors = 0;
+	ssize_t ret;
+
+	hdr = (void *)buf;
+	memset(buf, 0, len);
+	hdr->version = QRTR_PROTO_VER_1;
+	hdr->type = QRTR_TYPE_DATA;
+	hdr->src_node_id = cfg_remote_node;
+	hdr->src_port_id = 0x4000 + MAX_THREADS;
+	hdr->size = cfg_payload_len;
+	hdr->dst_node_id = local_node;
+
+	for (i = 0; i < cfg_num_ports * CHECK_MSGS; i++) {
+		hdr->dst_port_id = ports[i % cfg_num_ports].port;
+		fill_payload(buf + sizeof(*hdr), hdr->dst_port_id,
+			     i / cfg_num_ports);
+		if (write(tun_fd, buf, len) != len)
+			error(1, errno, "write %s", cfg_dev);
+	}
+
+	/* delivery to the sockets is asynchronous */
+	tstart = gettimeofday_ms();
+	while (done < cfg_num_ports &&
+	       gettimeofday_ms() - tstart < CHECK_WAIT_MS) {
+		for (i = 0; i < cfg_num_ports; i++) {
+			while ((ret = recv(ports[i].fd, buf, sizeof(buf), 0)) > 0) {
+				if (check_payload(buf, ret, ports[i].port) !=
+				    received[i]) {
+					fprintf(stderr, "port %u: bad payload "
+						"for message %d\n",
+						ports[i].port, received[i]);
+					errors++;
+				}
+				if (++received[i] == CHECK_MSGS)
+					done++;
+			}
+		}
+		drain_tun();
+		usleep(1000);
+	}
+
+	for (i = 0; i < cfg_num_ports; i++) {
+		if (received[i] != CHECK_MSGS) {
+			fprintf(stderr, "port %u: received %d of %d messages\n",
+				ports[i].port, received[i], CHECK_MSGS);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/*
+ * Send a batch with sendmmsg() to ports of the remote node, one message per
+ * port so that flow control doesn't kick in, and read it back from the tun
+ * endpoint.
+ */
+static int check_sendmmsg(void)
+{
+	static char bufs[MAX_BATCH][RX_BUF_LEN];
+	struct sockaddr_qrtr dst[MAX_BATCH];
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	int i, n, fd, seen = 0, errors = 0;
+	struct qrtr_hdr_v1 *hdr;
+	unsigned long tstart;
+	char buf[RX_BUF_LEN];
+	uint32_t port;
+	ssize_t ret;
+
+	n = cfg_batch > 1 ? cfg_batch : CHECK_MSGS;
+	fd = open_port(&port);
+	drain_tun();
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < n; i++) {
+		dst[i].sq_family = AF_QIPCRTR;
+		dst[i].sq_node = cfg_remote_node;
+		dst[i].sq_port = CHECK_PORT + i;
+		fill_payload(bufs[i], dst[i].sq_port, i);
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len = cfg_payload_len;
+		msgs[i].msg_hdr.msg_name = &dst[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(dst[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = sendmmsg(fd, msgs, n, 0);
+	if (ret != n)
+		error(1, errno, "sendmmsg: sent %zd of %d", ret, n);
+
+	hdr = (void *)buf;
+	tstart = gettimeofday_ms();
+	while (seen < n && gettimeofday_ms() - tstart < CHECK_WAIT_MS) {
+		ret = read(tun_fd, buf, sizeof(buf));
+		if (ret < 0) {
+			usleep(1000);
+			continue;
+		}
+		if (ret < sizeof(*hdr) || hdr->type != QRTR_TYPE_DATA ||
+		    hdr->src_port_id != port)
+			continue;
+
+		if (hdr->dst_node_id != cfg_remote_node ||
+		    hdr->dst_port_id != CHECK_PORT + seen ||
+		    hdr->size != cfg_payload_len ||
+		    ret < sizeof(*hdr) + hdr->size ||
+		    check_payload(buf + sizeof(*hdr), hdr->size,
+				  hdr->dst_port_id) != seen) {
+			fprintf(stderr, "sendmmsg: bad message %d\n", seen);
+			errors++;
+		}
+		seen++;
+	}
+
+	if (seen != n) {
+		fprintf(stderr, "sendmmsg: %d of %d messages on %s\n",
+			seen, n, cfg_dev);
+		errors++;
+	}
+
+	close(fd);
+	return errors;
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s [-b batch] [-c] [-d dev] [-l payload] [-n remote node] "
+		    "[-p ports] [-t threads] [-T seconds]", filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "b:cd:l:n:p:t:T:")) != -1) {
+		switch (c) {
+		case 'b':
+			cfg_batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cfg_churn = true;
+			break;
+		case 'd':
+			cfg_dev = optarg;
+			break;
+		case 'l':
+			cfg_payload_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_remote_node = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_num_ports = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_num_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			cfg_runtime_s = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_num_ports < 1 || cfg_num_ports > MAX_PORTS)
+		error(1, 0, "ports must be in [1, %d]", MAX_PORTS);
+	if (cfg_num_threads < 1 || cfg_num_threads > MAX_THREADS)
+		error(1, 0, "threads must be in [1, %d]", MAX_THREADS);
+	if (cfg_batch < 1 || cfg_batch > MAX_BATCH)
+		error(1, 0, "batch must be in [1, %d]", MAX_BATCH);
+	if (cfg_payload_len < sizeof(struct payload_tag) ||
+	    cfg_payload_len > 2048)
+		error(1, 0, "payload must be in [%zu, 2048]",
+		      sizeof(struct payload_tag));
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t threads[MAX_THREADS], churn;
+	unsigned long tstart, tstop, tx = 0, txerr = 0;
+	int errors;
+	long i;
+
+	parse_opts(argc, argv);
+
+	tun_fd = open(cfg_dev, O_RDWR | O_NONBLOCK);
+	if (tun_fd == -1)
+		error(1, errno, "open %s", cfg_dev);
+
+	for (i = 0; i < cfg_num_ports; i++) {
+		pthread_mutex_init(&ports[i].lock, NULL);
+		ports[i].fd = open_port(&ports[i].port);
+	}
+
+	tstart = gettimeofday_ms();
+	for (i = 0; i < cfg_num_threads; i++)
+		if (pthread_create(&threads[i], NULL, do_inject, (void *)i))
+			error(1, errno, "pthread_create");
+	if (cfg_churn && pthread_create(&churn, NULL, do_churn, NULL))
+		error(1, errno, "pthread_create");
+
+	while (gettimeofday_ms() - tstart < cfg_runtime_s * 1000UL) {
+		drain_ports();
+		drain_tun();
+		usleep(1000);
+	}
+	stop = true;
+
+	for (i = 0; i < cfg_num_threads; i++) {
+		pthread_join(threads[i], NULL);
+		tx += tx_total[i];
+		txerr += tx_errors[i];
+	}
+	if (cfg_churn)
+		pthread_join(churn, NULL);
+	tstop = gettimeofday_ms();
+
+	drain_ports();
+
+	fprintf(stderr, "qrtr tun: %lu ms, %d threads, %d ports, batch %d%s\n",
+		tstop - tstart, cfg_num_threads, cfg_num_ports, cfg_batch,
+		cfg_churn ? ", churn" : "");
+	fprintf(stderr, "  tx %lu msgs (%lu errors), %lu msg/s\n",
+		tx, txerr, tx * 1000 / (tstop - tstart ? : 1));
+	fprintf(stderr, "  rx %lu msgs (%lu bad), %lu msg/s\n",
+		rx_total, rx_bad, rx_total * 1000 / (tstop - tstart ? : 1));
+
+	if (!tx)
+		error(1, 0, "no packets injected");
+	if (rx_bad)
+		error(1, 0, "%lu corrupt packets received", rx_bad);
+	/* the rest was dropped on full receive queues or closed ports */
+	if (rx_total > tx)
+		error(1, 0, "received %lu packets, only %lu injected",
+		      rx_total, tx);
+
+	errors = check_delivery();
+	errors += check_sendmmsg();
+
+	for (i = 0; i < cfg_num_ports; i++)
+		close(ports[i].fd);
+	close(tun_fd);
+
+	if (errors)
+		error(1, 0, "%d delivery errors", errors);
+
+	fprintf(stderr, "  delivery and sendmmsg checks passed\n");
+	return 0;
+}
@@ -459,6 +459,27 @@ TEST_F(tls, splice_to_pipe)
 	EXPECT_EQ(memcmp(mem_send, mem_recv, send_len), 0);
 }
 
+TEST_F(tls, splice_to_pipe_multi_record)
+{
+	char mem_send[4096];
+	char mem_recv[4096];
+	int send_len = 1024;
+	int i, p[2];
+
+	for (i = 0; i < sizeof(mem_send); i++)
+		mem_send[i] = i;
+	ASSERT_GE(pipe(p), 0);
+	for (i = 0; i < 4; i++)
+		EXPECT_EQ(send(self->fd, mem_send + i * send_len,
+			       send_len, 0), send_len);
+
+	/* One splice call picks up all four records */
+	EXPECT_EQ(splice(self->cfd, NULL, p[1], NULL, 4 * send_len, 0),
+		  4 * send_len);
+	EXPECT_EQ(read(p[0], mem_recv, 4 * send_len), 4 * send_len);
+	EXPECT_EQ(memcmp(mem_send, mem_recv, 4 * send_len), 0);
+}
+
 TEST_F(tls, recvmsg_single)
 {
 	char const *test_str = "test_recvmsg_single";
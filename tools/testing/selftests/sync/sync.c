@@ -65,6 +65,28 @@ int sync_wait(int fd, int timeout)
 	return poll(&fds, 1, timeout);
 }
 
+int sync_wait_many(int *fds, int count, int wait_all, int timeout,
+		   int *first, int *status)
+{
+	struct sync_wait_data data = {};
+	int err;
+
+	data.fds = (uint64_t)fds;
+	data.status = (uint64_t)status;
+	data.num_fds = count;
+	data.flags = wait_all ? SYNC_WAIT_ALL : 0;
+	data.timeout_ns = timeout < 0 ? -1 : timeout * 1000000LL;
+
+	err = ioctl(fds[0], SYNC_IOC_WAIT, &data);
+	if (err < 0)
+		return err;
+
+	if (first)
+		*first = data.first_signaled;
+
+	return 0;
+}
+
 int sync_merge(const char *name, int fd1, int fd2)
 {
 	struct sync_merge_data data = {};
@@ -33,6 +33,8 @@
 #define FENCE_STATUS_SIGNALED	(1)
 
 int sync_wait(int fd, int timeout);
+int sync_wait_many(int *fds, int count, int wait_all, int timeout,
+		   int *first, int *status);
 int sync_merge(const char *name, int fd1, int fd2);
 int sync_fence_size(int fd);
 int sync_fence_count_with_status(int fd, int status);
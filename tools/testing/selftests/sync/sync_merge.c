@@ -25,6 +25,8 @@
  *  OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <time.h>
+
 #include "sync.h"
 #include "sw_sync.h"
 #include "synctest.h"
@@ -58,3 +60,62 @@ int test_fence_merge_same_fence(void)
 
 	return 0;
 }
+
+/*
+ * Compositor style accumulation: every frame merges one new fence per
+ * timeline into a running fence while the previous frame retires. The
+ * merged fence must stay at one fence per timeline, and the time per merge
+ * is reported as a microbenchmark.
+ */
+int test_fence_merge_accumulate(void)
+{
+	int timeline_count = 8;
+	int frame_count = 1024;
+	int timelines[timeline_count];
+	int i, frame, fence, merged, acc, size;
+	struct timespec start, end;
+	long long ns;
+
+	for (i = 0; i < timeline_count; i++)
+		timelines[i] = sw_sync_timeline_create();
+
+	acc = sw_sync_fence_create(timelines[0], "frame", 1);
+	ASSERT(sw_sync_fence_is_valid(acc), "Failure creating fence\n");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (frame = 1; frame <= frame_count; frame++) {
+		for (i = 0; i < timeline_count; i++) {
+			fence = sw_sync_fence_create(timelines[i], "frame",
+						     frame);
+			merged = sync_merge("acc", acc, fence);
+			ASSERT(sw_sync_fence_is_valid(merged),
+			       "Failure merging fences\n");
+
+			sw_sync_fence_destroy(fence);
+			sw_sync_fence_destroy(acc);
+			acc = merged;
+		}
+
+		/* Retire the previous frame */
+		if (frame > 1)
+			for (i = 0; i < timeline_count; i++)
+				sw_sync_timeline_inc(timelines[i], 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	size = sync_fence_size(acc);
+	ASSERT(size > 0 && size <= timeline_count,
+	       "Merged fence kept superseded or signaled fences\n");
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+	     (end.tv_nsec - start.tv_nsec);
+	ksft_print_msg("%d merges, %lld ns/merge\n",
+		       frame_count * timeline_count,
+		       ns / (frame_count * timeline_count));
+
+	sw_sync_fence_destroy(acc);
+	for (i = 0; i < timeline_count; i++)
+		sw_sync_timeline_destroy(timelines[i]);
+
+	return 0;
+}
@@ -86,7 +86,7 @@ int main(void)
 	int err;
 
 	ksft_print_header();
-	ksft_set_plan(3 + 7);
+	ksft_set_plan(3 + 9);
 
 	sync_api_supported();
 
@@ -99,7 +99,9 @@ int main(void)
 	RUN_TEST(test_fence_one_timeline_wait);
 	RUN_TEST(test_fence_one_timeline_merge);
 	RUN_TEST(test_fence_merge_same_fence);
+	RUN_TEST(test_fence_merge_accumulate);
 	RUN_TEST(test_fence_multi_timeline_wait);
+	RUN_TEST(test_fence_multi_fd_wait);
 	RUN_TEST(test_stress_two_threads_shared_timeline);
 	RUN_TEST(test_consumer_stress_multi_producer_single_consumer);
 	RUN_TEST(test_merge_stress_random_merge);
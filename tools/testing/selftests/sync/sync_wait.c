@@ -25,6 +25,8 @@
  *  OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
+
 #include "sync.h"
 #include "sw_sync.h"
 #include "synctest.h"
@@ -89,3 +91,52 @@ int test_fence_multi_timeline_wait(void)
 
 	return 0;
 }
+
+int test_fence_multi_fd_wait(void)
+{
+	int timelineA, timelineB;
+	int fences[4], status[4];
+	int first, ret, i;
+
+	timelineA = sw_sync_timeline_create();
+	timelineB = sw_sync_timeline_create();
+
+	/* Two fences on each timeline, so each context is waited on once */
+	fences[0] = sw_sync_fence_create(timelineA, "fenceA1", 1);
+	fences[1] = sw_sync_fence_create(timelineA, "fenceA2", 2);
+	fences[2] = sw_sync_fence_create(timelineB, "fenceB1", 1);
+	fences[3] = sw_sync_fence_create(timelineB, "fenceB2", 2);
+
+	ret = sync_wait_many(fences, 4, 0, 0, &first, NULL);
+	ASSERT(ret < 0 && errno == ETIME, "Fences signaled too early!\n");
+
+	sw_sync_timeline_inc(timelineB, 1);
+
+	ret = sync_wait_many(fences, 4, 0, 100, &first, status);
+	ASSERT(ret == 0 && first == 2,
+	       "Failure waiting for the first signaled fence\n");
+	ASSERT(status[0] == FENCE_STATUS_ACTIVE &&
+	       status[1] == FENCE_STATUS_ACTIVE &&
+	       status[2] == FENCE_STATUS_SIGNALED &&
+	       status[3] == FENCE_STATUS_ACTIVE,
+	       "Wrong fence status reported\n");
+
+	ret = sync_wait_many(fences, 4, 1, 0, NULL, NULL);
+	ASSERT(ret < 0 && errno == ETIME, "Fences signaled too early!\n");
+
+	sw_sync_timeline_inc(timelineA, 2);
+	sw_sync_timeline_inc(timelineB, 1);
+
+	ret = sync_wait_many(fences, 4, 1, 100, NULL, status);
+	ASSERT(ret == 0, "Failure waiting for all fences\n");
+	for (i = 0; i < 4; i++)
+		ASSERT(status[i] == FENCE_STATUS_SIGNALED,
+		       "Wrong fence status reported\n");
+
+	for (i = 0; i < 4; i++)
+		sw_sync_fence_destroy(fences[i]);
+	sw_sync_timeline_destroy(timelineB);
+	sw_sync_timeline_destroy(timelineA);
+
+	return 0;
+}
@@ -51,9 +51,11 @@ int test_fence_one_timeline_merge(void);
 
 /* Fence merge tests */
 int test_fence_merge_same_fence(void);
+int test_fence_merge_accumulate(void);
 
 /* Fence wait tests */
 int test_fence_multi_timeline_wait(void);
+int test_fence_multi_fd_wait(void);
 
 /* Stress test - parallelism */
 int test_stress_two_threads_shared_timeline(void);